@@ -0,0 +1,61 @@
+// 竞争下 adaptive_mutex 与 std::mutex、spin_lock 的对比：每次加锁的耗时和消耗的 CPU 时间
+// g++ -std=c++14 -O2 -I../include adaptive_mutex.cpp -o adaptive_mutex -pthread
+// ./adaptive_mutex [最大线程数，默认为 CPU 数的 4 倍]
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <ctime>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common/adaptive_mutex.h"
+
+// 临界区内做少量写操作，总加锁次数固定
+template<class Lock>
+static void run(const char *name, size_t threads, size_t total)
+{
+	Lock lock;
+	volatile uint64_t counter = 0;
+	size_t per_thread = total / threads;
+
+	std::clock_t cpu_start = std::clock();
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> workers;
+	for (size_t t = 0; t < threads; ++t)
+	{
+		workers.emplace_back([&] {
+			for (size_t i = 0; i < per_thread; ++i)
+			{
+				std::lock_guard<Lock> guard(lock);
+				for (int k = 0; k < 20; ++k)
+					counter = counter + 1;
+			}
+		});
+	}
+	for (auto &worker : workers)
+		worker.join();
+	double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	double cpu = static_cast<double>(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+
+	if (counter != per_thread * threads * 20)
+	{
+		printf("%s: lost updates\n", name);
+		exit(1);
+	}
+	printf("%-15s threads %3zu  %7.1f ns/lock  wall %6.3f s  cpu %6.3f s\n", name, threads, wall * 1e9 / static_cast<double>(per_thread * threads), wall, cpu);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t max_threads = argc > 1 ? static_cast<size_t>(atoi(argv[1])) : std::max(std::thread::hardware_concurrency(), 1u) * 4;
+	constexpr size_t total = 4000000;
+	for (size_t threads = 1; threads <= max_threads; threads *= 2)
+	{
+		run<std::mutex>("std::mutex", threads, total);
+		run<spin_lock>("spin_lock", threads, total);
+		run<adaptive_mutex>("adaptive_mutex", threads, total);
+	}
+	return 0;
+}
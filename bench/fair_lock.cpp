@@ -0,0 +1,90 @@
+// spin_lock、ticket_lock、mcs_lock 与 std::mutex 的公平性和尾延迟对比，2 到 64 个线程
+// g++ -std=c++14 -O2 -I../include fair_lock.cpp -o fair_lock -pthread
+// ./fair_lock [每轮运行的毫秒数，默认 300]
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common/histogram.hpp"
+#include "common/mcs_lock.h"
+#include "common/ticket_lock.h"
+
+using bench_clock = std::chrono::steady_clock;
+
+// 所有线程在 duration_ms 内反复加锁，记录每次等锁的时间和每个线程拿到锁的次数
+template<class Lock>
+static void run(const char *name, size_t threads, int duration_ms)
+{
+	Lock lock;
+	uint64_t shared = 0;
+	latency_histogram wait_ns;
+	std::vector<uint64_t> acquired(threads * 8);
+	std::atomic<bool> stop{ false };
+	std::atomic<size_t> ready{ 0 };
+
+	std::vector<std::thread> workers;
+	for (size_t t = 0; t < threads; ++t)
+	{
+		workers.emplace_back([&, t] {
+			++ready;
+			while (ready.load() < threads)
+				std::this_thread::yield();
+
+			uint64_t count = 0;
+			while (!stop.load(std::memory_order_relaxed))
+			{
+				auto begin = bench_clock::now();
+				lock.lock();
+				auto end = bench_clock::now();
+				for (int k = 0; k < 10; ++k)
+					shared = shared + 1;
+				lock.unlock();
+				wait_ns.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count()));
+				++count;
+			}
+			// 每个线程的计数隔开存放，避免伪共享影响结果
+			acquired[t * 8] = count;
+		});
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(duration_ms));
+	stop = true;
+	for (auto &worker : workers)
+		worker.join();
+
+	uint64_t total = 0, least = UINT64_MAX, most = 0;
+	for (size_t t = 0; t < threads; ++t)
+	{
+		total += acquired[t * 8];
+		least = std::min(least, acquired[t * 8]);
+		most = std::max(most, acquired[t * 8]);
+	}
+	if (shared != total * 10)
+	{
+		printf("%s: lost updates\n", name);
+		exit(1);
+	}
+
+	latency_histogram::snapshot wait = wait_ns.get_snapshot();
+	printf("%-11s %3zu %8.2f %10llu %12llu %12llu %10.3f\n", name, threads, static_cast<double>(total) / duration_ms / 1000.0,
+		static_cast<unsigned long long>(wait.percentile(99)), static_cast<unsigned long long>(wait.percentile(99.9)),
+		static_cast<unsigned long long>(wait.max), most ? static_cast<double>(least) / static_cast<double>(most) : 0.0);
+}
+
+int main(int argc, char *argv[])
+{
+	int duration_ms = argc > 1 ? atoi(argv[1]) : 300;
+	printf("%-11s %3s %8s %10s %12s %12s %10s\n", "lock", "thr", "M/s", "p99 ns", "p99.9 ns", "max ns", "min/max");
+	for (size_t threads : { 2, 4, 8, 16, 32, 64 })
+	{
+		run<std::mutex>("std::mutex", threads, duration_ms);
+		run<spin_lock>("spin_lock", threads, duration_ms);
+		run<ticket_lock>("ticket_lock", threads, duration_ms);
+		run<mcs_lock>("mcs_lock", threads, duration_ms);
+	}
+	return 0;
+}
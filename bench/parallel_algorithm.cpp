@@ -0,0 +1,107 @@
+// parallel_for/parallel_reduce/parallel_sort 与串行循环、std::execution::par 的对比
+// g++ -std=c++17 -O2 -I../include parallel_algorithm.cpp -o parallel_algorithm -pthread -ltbb
+// ./parallel_algorithm [线程数，默认为 CPU 数]
+// libstdc++ 的并行算法依赖 TBB；使用 C++14 编译时不需要 TBB，也不测 std::execution::par
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<execution>)
+#include <execution>
+#define BENCH_HAS_EXECUTION 1
+#endif
+#endif
+
+#include "common/thread_pool_algorithm.hpp"
+
+template<class F>
+static double measure_ms(F &&f)
+{
+	// 取三次中最快的一次
+	double best = 1e300;
+	for (int i = 0; i < 3; ++i)
+	{
+		auto start = std::chrono::steady_clock::now();
+		f();
+		best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+	return best;
+}
+
+static void report(const char *name, double serial, double pool, double par)
+{
+	if (par >= 0)
+		printf("%-22s serial %8.2f ms   parallel %8.2f ms (%5.2fx)   std::execution::par %8.2f ms (%5.2fx)\n", name, serial, pool, serial / pool, par, serial / par);
+	else
+		printf("%-22s serial %8.2f ms   parallel %8.2f ms (%5.2fx)\n", name, serial, pool, serial / pool);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t threads = argc > 1 ? static_cast<size_t>(atoi(argv[1])) : std::max(std::thread::hardware_concurrency(), 1u);
+	ThreadPool pool(threads);
+	pool.add_group(1);
+	printf("pool threads %zu\n", threads);
+
+	constexpr size_t count = 1 << 23;
+	std::vector<double> input(count), output(count);
+	std::iota(input.begin(), input.end(), 0.0);
+	auto transform = [](double x) { return std::sqrt(x) * std::sin(x); };
+
+	// 每个元素开销很小的变换
+	{
+		double serial = measure_ms([&] {
+			for (size_t i = 0; i < count; ++i)
+				output[i] = transform(input[i]);
+		});
+		double parallel = measure_ms([&] {
+			parallel_for(pool, 1, size_t(0), count, [&](size_t i) { output[i] = transform(input[i]); });
+		});
+		double par = -1;
+#if BENCH_HAS_EXECUTION
+		par = measure_ms([&] {
+			std::transform(std::execution::par, input.begin(), input.end(), output.begin(), transform);
+		});
+#endif
+		report("for (sqrt*sin)", serial, parallel, par);
+	}
+
+	// 求和
+	{
+		volatile double sink = 0;
+		double serial = measure_ms([&] { sink = std::accumulate(input.begin(), input.end(), 0.0); });
+		double parallel = measure_ms([&] { sink = parallel_reduce(pool, 1, input.begin(), input.end(), 0.0); });
+		double par = -1;
+#if BENCH_HAS_EXECUTION
+		par = measure_ms([&] { sink = std::reduce(std::execution::par, input.begin(), input.end(), 0.0); });
+#endif
+		(void)sink;
+		report("reduce (sum)", serial, parallel, par);
+	}
+
+	// 排序，每次都从同一份乱序数据开始
+	{
+		std::vector<uint64_t> shuffled(count);
+		std::mt19937_64 random(1);
+		for (auto &value : shuffled)
+			value = random();
+		std::vector<uint64_t> data;
+
+		double serial = measure_ms([&] { data = shuffled; std::sort(data.begin(), data.end()); });
+		double parallel = measure_ms([&] { data = shuffled; parallel_sort(pool, 1, data.begin(), data.end()); });
+		double par = -1;
+#if BENCH_HAS_EXECUTION
+		par = measure_ms([&] { data = shuffled; std::sort(std::execution::par, data.begin(), data.end()); });
+#endif
+		report("sort (uint64)", serial, parallel, par);
+	}
+	return 0;
+}
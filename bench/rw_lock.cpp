@@ -0,0 +1,129 @@
+// 读多写少时读者的扩展性：std::mutex、std::shared_timed_mutex、rw_spin_lock（读优先/写优先）与 seqlock
+// g++ -std=c++14 -O2 -I../include rw_lock.cpp -o rw_lock -pthread
+// ./rw_lock [最大读线程数，默认为 CPU 数]
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+#include "common/rw_spin_lock.h"
+#include "common/seqlock.h"
+
+// 模拟一份小的路由表快照，b、c 由 a 推出，读到不一致的值说明读到了写了一半的数据
+struct route
+{
+	uint64_t a;
+	uint64_t b;
+	uint32_t c;
+};
+
+static route make_route(uint64_t value)
+{
+	return route{ value, value * 2, static_cast<uint32_t>(value + 7) };
+}
+
+// 读者用 ReadGuard 加锁：std::shared_lock 为共享锁，std::lock_guard 为独占锁
+template<class Lock, template<class> class ReadGuard>
+class locked_route
+{
+public:
+	template<class... Args>
+	explicit locked_route(Args&&... args) : lock(std::forward<Args>(args)...) {}
+
+	route read()
+	{
+		ReadGuard<Lock> guard(lock);
+		return value;
+	}
+
+	void write(uint64_t next)
+	{
+		std::lock_guard<Lock> guard(lock);
+		value = make_route(next);
+	}
+
+private:
+	Lock lock;
+	route value = make_route(0);
+};
+
+class seqlock_route
+{
+public:
+	route read() { return value.load(); }
+	void write(uint64_t next) { value.store(make_route(next)); }
+
+private:
+	seqlock<route> value{ make_route(0) };
+};
+
+// readers 个线程持续读 300ms，writer 为 true 时另有一个线程每 100us 写一次
+template<class Table, class... Args>
+static void run(const char *name, size_t readers, bool writer, Args&&... args)
+{
+	Table table(std::forward<Args>(args)...);
+	std::atomic<bool> stop{ false };
+	std::vector<uint64_t> reads(readers * 8);
+	uint64_t writes = 0;
+
+	std::vector<std::thread> threads;
+	for (size_t r = 0; r < readers; ++r)
+	{
+		threads.emplace_back([&, r] {
+			uint64_t count = 0;
+			while (!stop.load(std::memory_order_relaxed))
+			{
+				route value = table.read();
+				if (value.b != value.a * 2 || value.c != static_cast<uint32_t>(value.a + 7))
+				{
+					printf("%s: torn read\n", name);
+					exit(1);
+				}
+				++count;
+			}
+			reads[r * 8] = count;
+		});
+	}
+	if (writer)
+	{
+		threads.emplace_back([&] {
+			while (!stop.load(std::memory_order_relaxed))
+			{
+				table.write(++writes);
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+			}
+		});
+	}
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+	stop = true;
+	for (auto &thread : threads)
+		thread.join();
+
+	uint64_t total = 0;
+	for (size_t r = 0; r < readers; ++r)
+		total += reads[r * 8];
+	printf("%-24s %7zu %6s %12.1f %8llu\n", name, readers, writer ? "yes" : "no", static_cast<double>(total) / 0.3 / 1e6, static_cast<unsigned long long>(writes));
+}
+
+int main(int argc, char *argv[])
+{
+	size_t max_readers = argc > 1 ? static_cast<size_t>(atoi(argv[1])) : std::max(std::thread::hardware_concurrency(), 1u);
+	printf("%-24s %7s %6s %12s %8s\n", "lock", "readers", "writer", "M reads/s", "writes");
+	for (size_t readers = 1; readers <= max_readers; readers *= 2)
+	{
+		for (bool writer : { false, true })
+		{
+			run<locked_route<std::mutex, std::lock_guard>>("std::mutex", readers, writer);
+			run<locked_route<std::shared_timed_mutex, std::shared_lock>>("std::shared_timed_mutex", readers, writer);
+			run<locked_route<rw_spin_lock, std::shared_lock>>("rw_spin_lock", readers, writer);
+			run<locked_route<rw_spin_lock, std::shared_lock>>("rw_spin_lock(writer)", readers, writer, true);
+			run<seqlock_route>("seqlock", readers, writer);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,96 @@
+// test-and-set 与 test-and-test-and-set 自旋锁的对比，以及 padded_spin_lock 避免伪共享的效果
+// g++ -std=c++17 -O2 -I../include spin_lock.cpp -o spin_lock -pthread
+// padded_spin_lock 放在 std::vector 中，C++17 之前动态分配不保证 64 字节对齐
+// ./spin_lock [最大线程数，默认为 CPU 数]
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common/spin_lock.h"
+
+// 原来的实现：等待时反复 test_and_set，每次都以独占方式抢占缓存行
+class tas_lock
+{
+public:
+	void lock()
+	{
+		while (flag.test_and_set(std::memory_order_acquire))
+			cpu_relax();
+	}
+
+	void unlock()
+	{
+		flag.clear(std::memory_order_release);
+	}
+
+private:
+	std::atomic_flag flag = ATOMIC_FLAG_INIT;
+};
+
+template<class F>
+static double ns_per_op(size_t threads, size_t per_thread, F &&body)
+{
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> workers;
+	for (size_t t = 0; t < threads; ++t)
+		workers.emplace_back([&, t] { body(t); });
+	for (auto &worker : workers)
+		worker.join();
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / static_cast<double>(threads * per_thread);
+}
+
+// 所有线程竞争同一把锁
+template<class Lock>
+static double shared_lock(size_t threads, size_t per_thread)
+{
+	Lock lock;
+	uint64_t counter = 0;
+	return ns_per_op(threads, per_thread, [&](size_t) {
+		for (size_t i = 0; i < per_thread; ++i)
+		{
+			std::lock_guard<Lock> guard(lock);
+			++counter;
+		}
+	});
+}
+
+// 每个线程一把锁，锁在数组中相邻存放，没有竞争，只有伪共享
+template<class Lock>
+static double neighbour_locks(size_t threads, size_t per_thread)
+{
+	std::vector<Lock> locks(threads);
+	std::vector<uint64_t> counters(threads * cache_line_size / sizeof(uint64_t));
+	return ns_per_op(threads, per_thread, [&](size_t t) {
+		for (size_t i = 0; i < per_thread; ++i)
+		{
+			std::lock_guard<Lock> guard(locks[t]);
+			++counters[t * cache_line_size / sizeof(uint64_t)];
+		}
+	});
+}
+
+int main(int argc, char *argv[])
+{
+	size_t max_threads = argc > 1 ? static_cast<size_t>(atoi(argv[1])) : std::max(std::thread::hardware_concurrency(), 1u);
+	constexpr size_t total = 4000000;
+
+	printf("one shared lock, ns per lock\n%8s %10s %10s %18s\n", "threads", "tas", "spin_lock", "padded_spin_lock");
+	for (size_t threads = 1; threads <= max_threads; threads *= 2)
+	{
+		size_t per_thread = total / threads;
+		printf("%8zu %10.1f %10.1f %18.1f\n", threads, shared_lock<tas_lock>(threads, per_thread),
+			shared_lock<spin_lock>(threads, per_thread), shared_lock<padded_spin_lock>(threads, per_thread));
+	}
+
+	printf("one lock per thread in an array, ns per lock\n%8s %10s %18s\n", "threads", "spin_lock", "padded_spin_lock");
+	for (size_t threads = 2; threads <= std::max<size_t>(max_threads, 2); threads *= 2)
+	{
+		size_t per_thread = total / threads;
+		printf("%8zu %10.1f %18.1f\n", threads, neighbour_locks<spin_lock>(threads, per_thread), neighbour_locks<padded_spin_lock>(threads, per_thread));
+	}
+	return 0;
+}
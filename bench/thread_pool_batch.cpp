@@ -0,0 +1,89 @@
+// 逐个提交与批量提交的对比：post 对比 post_bulk，push_back_task 对比 push_back_tasks
+// g++ -std=c++14 -O2 -I../include thread_pool_batch.cpp -o thread_pool_batch -pthread
+// ./thread_pool_batch [线程数，默认为 CPU 数]
+
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "common/thread_pool.h"
+
+using bench_clock = std::chrono::steady_clock;
+
+static double elapsed_ns(bench_clock::time_point start)
+{
+	return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start).count());
+}
+
+struct result
+{
+	double submit_ns;
+	double total_ns;
+};
+
+// 每轮提交 batch 个任务，共 rounds 轮，返回平均每个任务的提交耗时和到全部执行完的耗时
+template<class Submit>
+static result run(size_t threads, size_t batch, size_t rounds, Submit submit)
+{
+	ThreadPool pool(threads, true);
+	pool.add_group(1);
+	std::atomic<size_t> done{ 0 };
+
+	double submit_ns = 0;
+	auto start = bench_clock::now();
+	for (size_t round = 0; round < rounds; ++round)
+	{
+		auto submit_start = bench_clock::now();
+		submit(pool, batch, done);
+		submit_ns += elapsed_ns(submit_start);
+	}
+	while (done.load(std::memory_order_relaxed) < batch * rounds)
+		std::this_thread::yield();
+	double total_ns = elapsed_ns(start);
+
+	double tasks = static_cast<double>(batch * rounds);
+	return { submit_ns / tasks, total_ns / tasks };
+}
+
+int main(int argc, char *argv[])
+{
+	size_t threads = argc > 1 ? static_cast<size_t>(atoi(argv[1])) : std::max(std::thread::hardware_concurrency(), 1u);
+	constexpr size_t total = 1000000;
+
+	printf("threads %zu, %zu tasks, ns per task (submit / until all done)\n", threads, total);
+	printf("%6s %22s %22s %22s %22s\n", "batch", "post", "post_bulk", "push_back_task", "push_back_tasks");
+	for (size_t batch : { 1, 16, 256, 4096 })
+	{
+		size_t rounds = total / batch;
+
+		result post = run(threads, batch, rounds, [](ThreadPool &pool, size_t count, std::atomic<size_t> &done) {
+			for (size_t i = 0; i < count; ++i)
+				pool.post(1, [&done] { done.fetch_add(1, std::memory_order_relaxed); });
+		});
+
+		result bulk = run(threads, batch, rounds, [](ThreadPool &pool, size_t count, std::atomic<size_t> &done) {
+			auto task = [&done] { done.fetch_add(1, std::memory_order_relaxed); };
+			std::vector<decltype(task)> tasks(count, task);
+			pool.post_bulk(1, tasks);
+		});
+
+		result single = run(threads, batch, rounds, [](ThreadPool &pool, size_t count, std::atomic<size_t> &done) {
+			for (size_t i = 0; i < count; ++i)
+				pool.push_back_task(1, [&done] { done.fetch_add(1, std::memory_order_relaxed); });
+		});
+
+		result tasks = run(threads, batch, rounds, [](ThreadPool &pool, size_t count, std::atomic<size_t> &done) {
+			auto task = [&done] { done.fetch_add(1, std::memory_order_relaxed); };
+			std::vector<decltype(task)> tasks(count, task);
+			pool.push_back_tasks(1, tasks);
+		});
+
+		printf("%6zu %10.1f / %9.1f %10.1f / %9.1f %10.1f / %9.1f %10.1f / %9.1f\n", batch,
+			post.submit_ns, post.total_ns, bulk.submit_ns, bulk.total_ns,
+			single.submit_ns, single.total_ns, tasks.submit_ns, tasks.total_ns);
+	}
+	return 0;
+}
@@ -0,0 +1,67 @@
+// 弹性线程数下所有线程都被长任务占住时，排队的任务能否在 scale_up_wait_us 左右开始执行
+// g++ -std=c++14 -O2 -I../include thread_pool_elastic.cpp -o thread_pool_elastic -pthread
+// ./thread_pool_elastic
+// 一次提交完所有任务，之后不再提交；第一个线程取到任务后阻塞，此后没有任何提交和取出任务的时机
+// 每个任务都阻塞 block_ms，只有增加线程才能让排在后面的任务开始执行；有任务等待超过 limit_ms 时返回 1
+
+#include <cstdio>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "common/thread_pool.h"
+
+using bench_clock = std::chrono::steady_clock;
+
+constexpr size_t tasks = 4;
+constexpr int block_ms = 300;
+constexpr int limit_ms = 50;
+
+static bool run(bool work_stealing)
+{
+	ThreadPoolOptions options;
+	options.threads = 1;
+	options.max_threads = tasks;
+	options.scale_up_wait_us = 1000;
+	options.work_stealing = work_stealing;
+	options.wait_on_quit = true;
+
+	std::vector<double> waits(tasks, 0.0);
+	std::atomic<size_t> started{ 0 };
+	{
+		ThreadPool pool(options);
+		pool.add_group(1);
+
+		auto submit = bench_clock::now();
+		std::vector<std::function<void()>> batch;
+		for (size_t i = 0; i < tasks; ++i)
+		{
+			batch.push_back([&waits, &started, submit, i] {
+				waits[i] = std::chrono::duration<double, std::milli>(bench_clock::now() - submit).count();
+				++started;
+				std::this_thread::sleep_for(std::chrono::milliseconds(block_ms));
+			});
+		}
+		pool.post_bulk(1, batch);
+
+		// 停止后不再增加线程，等所有任务都开始执行后再析构
+		while (started < tasks)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	double max_wait = *std::max_element(waits.begin(), waits.end());
+	printf("%-13s task waits (ms):", work_stealing ? "work_stealing" : "global queue");
+	for (double wait : waits)
+		printf(" %6.1f", wait);
+	printf("  %s\n", max_wait <= limit_ms ? "ok" : "FAILED");
+	return max_wait <= limit_ms;
+}
+
+int main()
+{
+	bool ok = run(false);
+	ok = run(true) && ok;
+	return ok ? 0 : 1;
+}
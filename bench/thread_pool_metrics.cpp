@@ -0,0 +1,109 @@
+// ThreadPoolOptions::metrics 的开销：空任务与约 1us 的任务，关闭与开启指标（按 metrics_sample 采样）时线程执行每个任务的耗时
+// g++ -std=c++14 -O2 -I../include thread_pool_metrics.cpp -o thread_pool_metrics -pthread
+// ./thread_pool_metrics [线程数，默认为 CPU 数] [重复次数，默认 7]
+// 各配置交替运行，取每个配置的最小值以排除其他进程的干扰，开销为相对关闭指标时的增加比例
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "common/thread_pool.h"
+
+using bench_clock = std::chrono::steady_clock;
+
+// 忙等 ns 纳秒，模拟很短的任务
+static void spin_for(int64_t ns)
+{
+	if (ns <= 0)
+		return;
+	auto until = bench_clock::now() + std::chrono::nanoseconds(ns);
+	while (bench_clock::now() < until)
+		;
+}
+
+// 先让所有线程阻塞在 gate 上，提交 count 个任务后再放开，只统计线程取出并执行任务的耗时，返回平均每个任务的耗时
+static double run(size_t threads, bool metrics, uint32_t sample, size_t count, int64_t task_ns)
+{
+	ThreadPoolOptions options;
+	options.threads = threads;
+	options.wait_on_quit = true;
+	options.metrics = metrics;
+	options.metrics_sample = sample;
+	ThreadPool pool(options);
+	pool.add_group(1);
+
+	std::atomic<bool> gate{ false };
+	std::atomic<size_t> blocked{ 0 };
+	for (size_t i = 0; i < threads; ++i)
+	{
+		pool.post(1, [&] {
+			blocked.fetch_add(1);
+			while (!gate.load())
+				std::this_thread::yield();
+		});
+	}
+	while (blocked.load() < threads)
+		std::this_thread::yield();
+
+	std::atomic<size_t> done{ 0 };
+	for (size_t i = 0; i < count; ++i)
+	{
+		pool.post(1, [&done, task_ns] {
+			spin_for(task_ns);
+			done.fetch_add(1, std::memory_order_relaxed);
+		});
+	}
+
+	auto start = bench_clock::now();
+	gate = true;
+	while (done.load(std::memory_order_relaxed) < count)
+		std::this_thread::yield();
+	return std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / static_cast<double>(count);
+}
+
+static double best(const std::vector<double> &values)
+{
+	return *std::min_element(values.begin(), values.end());
+}
+
+int main(int argc, char *argv[])
+{
+	size_t threads = argc > 1 ? static_cast<size_t>(atoi(argv[1])) : std::max(std::thread::hardware_concurrency(), 1u);
+	size_t repeat = argc > 2 ? static_cast<size_t>(atoi(argv[2])) : 7;
+
+	struct config
+	{
+		const char *name;
+		bool metrics;
+		uint32_t sample;
+	};
+	const config configs[] = {
+		{ "off", false, 16 },
+		{ "on, sample 64", true, 64 },
+		{ "on, sample 16", true, 16 },
+		{ "on, sample 1", true, 1 },
+	};
+
+	printf("threads %zu, best of %zu runs, ns per task (overhead vs off)\n", threads, repeat);
+	for (int64_t task_ns : { 0, 1000 })
+	{
+		size_t count = task_ns ? 200000 : 1000000;
+		std::vector<std::vector<double>> results(sizeof(configs) / sizeof(configs[0]));
+		for (size_t round = 0; round < repeat; ++round)
+			for (size_t i = 0; i < results.size(); ++i)
+				results[i].push_back(run(threads, configs[i].metrics, configs[i].sample, count, task_ns));
+
+		double base = best(results[0]);
+		printf("%s task:\n", task_ns ? "1us" : "empty");
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			double value = best(results[i]);
+			printf("  %-14s %8.1f ns  %+6.1f%%\n", configs[i].name, value, (value / base - 1.0) * 100.0);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,67 @@
+// ThreadPool 吞吐量随线程数的变化，对比全局锁模式和工作窃取模式
+// g++ -std=c++14 -O2 -I../include thread_pool_scaling.cpp -o thread_pool_scaling -pthread
+// ./thread_pool_scaling [最大线程数，默认为 CPU 数]
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+
+#include "common/thread_pool.h"
+
+// 空任务只测调度开销，1us 的任务更接近实际负载
+static void spin_for(int64_t ns)
+{
+	auto end = std::chrono::steady_clock::now() + std::chrono::nanoseconds(ns);
+	while (std::chrono::steady_clock::now() < end)
+	{
+	}
+}
+
+static double run(size_t threads, bool work_stealing, size_t tasks, int64_t task_ns)
+{
+	ThreadPoolOptions options;
+	options.threads = threads;
+	options.work_stealing = work_stealing;
+	options.wait_on_quit = true;
+
+	auto start = std::chrono::steady_clock::now();
+	{
+		ThreadPool pool(options);
+		constexpr uint32_t groups = 8;
+		for (uint32_t group = 0; group < groups; ++group)
+			pool.add_group(group);
+
+		// 多个提交线程，避免单个提交者成为瓶颈
+		size_t producers = std::max<size_t>(threads / 2, 1);
+		std::vector<std::thread> submitters;
+		for (size_t p = 0; p < producers; ++p)
+		{
+			submitters.emplace_back([&, p] {
+				for (size_t i = p; i < tasks; i += producers)
+					pool.post(static_cast<uint32_t>(i % groups), [task_ns] { if (task_ns) spin_for(task_ns); });
+			});
+		}
+		for (auto &t : submitters)
+			t.join();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return static_cast<double>(tasks) / seconds;
+}
+
+int main(int argc, char *argv[])
+{
+	size_t max_threads = argc > 1 ? static_cast<size_t>(atoi(argv[1])) : std::max(std::thread::hardware_concurrency(), 1u);
+	printf("%8s %10s %16s %16s\n", "threads", "task", "global tasks/s", "stealing tasks/s");
+	for (int64_t task_ns : { 0, 1000 })
+	{
+		for (size_t threads = 1; threads <= max_threads; threads *= 2)
+		{
+			size_t tasks = task_ns ? 200000 : 1000000;
+			double global = run(threads, false, tasks, task_ns);
+			double stealing = run(threads, true, tasks, task_ns);
+			printf("%8zu %8lldns %16.0f %16.0f\n", threads, static_cast<long long>(task_ns), global, stealing);
+		}
+	}
+	return 0;
+}
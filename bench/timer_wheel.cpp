@@ -0,0 +1,98 @@
+// TimerExecutor 在 1M 到 10M 个定时器下，二叉堆与时间轮的添加、重新设置、删除开销和内存占用
+// g++ -std=c++14 -O2 -I../include timer_wheel.cpp -o timer_wheel -pthread
+// ./timer_wheel [最大定时器数，默认 10000000]
+// 只支持 Linux：使用 timerfd 模式，由本线程调用 run_expired 处理命令，测得的是包括定时器结构更新在内的完整开销
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "common/timer.hpp"
+
+static size_t rss_bytes()
+{
+	long pages = 0, resident = 0;
+	FILE *file = fopen("/proc/self/statm", "r");
+	if (file)
+	{
+		if (fscanf(file, "%ld %ld", &pages, &resident) != 2)
+			resident = 0;
+		fclose(file);
+	}
+	return static_cast<size_t>(resident) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+template<class F>
+static double ns_per_op(size_t count, F &&f)
+{
+	auto start = std::chrono::steady_clock::now();
+	f();
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / static_cast<double>(count);
+}
+
+static void run(bool wheel, size_t count)
+{
+	TimerExecutorOptions options;
+	options.timerfd = true;
+	options.timing_wheel = wheel;
+	options.tick_us = 1000;
+
+	std::mt19937 random(1);
+	std::vector<uint64_t> handles(count);
+	size_t rss_before = rss_bytes();
+	{
+		TimerExecutor executor(options);
+		// 模拟连接的空闲超时：60 到 120 秒，测试期间都不会到期
+		double arm = ns_per_op(count, [&] {
+			for (size_t i = 0; i < count; ++i)
+				handles[i] = executor.timeout(60000 + random() % 60000, [] {});
+			executor.run_expired();
+		});
+		size_t memory = rss_bytes() - rss_before;
+
+		double rearm = ns_per_op(count, [&] {
+			for (size_t i = 0; i < count; ++i)
+				executor.rearm(handles[i], 60000 + random() % 60000);
+			executor.run_expired();
+		});
+
+		double cancel = ns_per_op(count, [&] {
+			for (size_t i = 0; i < count; ++i)
+				executor.remove_task(handles[i]);
+			executor.run_expired();
+		});
+
+		printf("%-6s %9zu timers  arm %7.1f ns  rearm %7.1f ns  cancel %7.1f ns  memory %6.1f MB (%5.1f B/timer)\n",
+			wheel ? "wheel" : "heap", count, arm, rearm, cancel,
+			static_cast<double>(memory) / 1048576.0, static_cast<double>(memory) / static_cast<double>(count));
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	size_t max_count = argc > 1 ? static_cast<size_t>(atoll(argv[1])) : 10000000;
+	for (size_t count : { 1000000, 2000000, 5000000, 10000000 })
+	{
+		if (count > max_count)
+			break;
+		// 每次在新的子进程中运行，内存占用不受上一次运行释放的内存影响
+		for (bool wheel : { false, true })
+		{
+			fflush(stdout);
+			pid_t child = fork();
+			if (child == 0)
+			{
+				run(wheel, count);
+				fflush(stdout);
+				_exit(0);
+			}
+			waitpid(child, nullptr, 0);
+		}
+	}
+	return 0;
+}
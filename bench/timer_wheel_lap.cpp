@@ -0,0 +1,99 @@
+// 时间轮跨圈的定时器是否准时：随机到期时间跨过多个第 0 层的圈（256 个 tick），每圈的起点都需要从上层 cascade
+// g++ -std=c++14 -O2 -I../include timer_wheel_lap.cpp -o timer_wheel_lap -pthread
+// ./timer_wheel_lap [定时器数，默认 2000]
+// 只支持 Linux：使用 timerfd 模式，每次 run_expired 后读出时间轮设置的唤醒时间，检查它不晚于最早未触发定时器的到期时间加一个 tick
+// 检查的是时间轮自己安排的时间，不受线程调度误差影响；有定时器提前触发、唤醒时间晚了或定时器没有触发时返回 1
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include <poll.h>
+#include <sys/timerfd.h>
+
+#include "common/timer.hpp"
+
+static int64_t now_us()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char **argv)
+{
+	size_t count = argc > 1 ? static_cast<size_t>(std::strtoull(argv[1], nullptr, 10)) : 2000;
+	const int64_t tick_us = 1000;
+
+	TimerExecutorOptions options;
+	options.timerfd = true;
+	options.timing_wheel = true;
+	options.tick_us = static_cast<uint32_t>(tick_us);
+	TimerExecutor executor(options);
+
+	// 10 到 1010ms，覆盖约 4 圈；executor 记录的到期时间在 [earliest, latest] 之间
+	std::mt19937 random(1);
+	std::vector<int64_t> earliest(count), latest(count), fired(count, 0);
+	for (size_t i = 0; i < count; ++i)
+	{
+		uint32_t ms = 10 + random() % 1000;
+		earliest[i] = now_us() + int64_t(ms) * 1000;
+		executor.timeout(ms, [&fired, i] { fired[i] = now_us(); });
+		latest[i] = now_us() + int64_t(ms) * 1000;
+	}
+
+	size_t early = 0, late_wakeups = 0, remaining = count;
+	int64_t max_late = 0, max_fire_late = 0;
+	pollfd pfd{ executor.fd(), POLLIN, 0 };
+	while (remaining > 0)
+	{
+		executor.run_expired();
+
+		remaining = 0;
+		int64_t next_due = std::numeric_limits<int64_t>::max();
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (fired[i])
+				continue;
+			++remaining;
+			next_due = std::min(next_due, latest[i]);
+		}
+		if (remaining == 0)
+			break;
+
+		// 读出的剩余时间不会超过真实的唤醒时间，剩余时间为 0 表示已经到期或者被取消
+		itimerspec spec{};
+		int64_t now = now_us();
+		timerfd_gettime(executor.fd(), &spec);
+		int64_t remain_us = int64_t(spec.it_value.tv_sec) * 1000000 + spec.it_value.tv_nsec / 1000;
+		if (remain_us == 0 && spec.it_value.tv_nsec == 0 && poll(&pfd, 1, 0) == 0)
+		{
+			printf("timerfd disarmed with %zu timers pending\n", remaining);
+			return 1;
+		}
+
+		// 已经到期时唤醒时间早于 now，迟到的只是本线程被调度的时间
+		if (remain_us > 0)
+		{
+			int64_t late = now + remain_us - next_due;
+			max_late = std::max(max_late, late);
+			if (late > tick_us)
+				++late_wakeups;
+		}
+
+		poll(&pfd, 1, -1);
+	}
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (fired[i] < earliest[i])
+			++early;
+		max_fire_late = std::max(max_fire_late, fired[i] - latest[i]);
+	}
+
+	printf("timers %zu, early %zu, late wakeups %zu, max wakeup late %.3fms, max fire late %.3fms\n",
+		count, early, late_wakeups, static_cast<double>(max_late) / 1000.0, static_cast<double>(max_fire_late) / 1000.0);
+	return early || late_wakeups ? 1 : 0;
+}
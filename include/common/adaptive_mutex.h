@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "spin_lock.h"
+
+#if _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#if defined(_MSC_VER)
+#pragma comment(lib, "Synchronization.lib")
+#endif
+#elif __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// 先用 pause 自旋等待持有者释放，超过自旋次数后在 futex 上睡眠，持有者长时间不释放时不会像 spin_lock 那样反复 yield 消耗时间片
+// 自旋次数参考 glibc 的 PTHREAD_MUTEX_ADAPTIVE_NP，按最近几次加锁实际自旋的次数调整，单核机器上不自旋
+// 接口与 spin_lock、std::mutex 相同，可以直接用于 std::lock_guard/std::unique_lock
+class adaptive_mutex
+{
+public:
+	adaptive_mutex() = default;
+	adaptive_mutex(const adaptive_mutex &) = delete;
+	adaptive_mutex(adaptive_mutex &&) = delete;
+	adaptive_mutex& operator=(const adaptive_mutex &) = delete;
+
+	void lock()
+	{
+		uint32_t expected = unlocked;
+		if (!state.compare_exchange_strong(expected, locked, std::memory_order_acquire, std::memory_order_relaxed))
+			lock_slow();
+	}
+
+	bool try_lock()
+	{
+		uint32_t expected = unlocked;
+		return state.compare_exchange_strong(expected, locked, std::memory_order_acquire, std::memory_order_relaxed);
+	}
+
+	void unlock()
+	{
+		// 只有可能存在睡眠的线程时才需要系统调用
+		if (state.exchange(unlocked, std::memory_order_release) == contended)
+			wake_one();
+	}
+
+private:
+	void lock_slow()
+	{
+		if (multi_core())
+		{
+			int32_t average = spins.load(std::memory_order_relaxed);
+			int32_t max_spins = std::min<int32_t>(int32_t(max_adaptive_spins), average * 2 + 10);
+			for (int32_t count = 0; count < max_spins; ++count)
+			{
+				// 只读等待，避免自旋时反复抢占缓存行
+				uint32_t current = state.load(std::memory_order_relaxed);
+				if (current == unlocked && state.compare_exchange_weak(current, locked, std::memory_order_acquire, std::memory_order_relaxed))
+				{
+					spins.store(average + (count - average) / 8, std::memory_order_relaxed);
+					return;
+				}
+				cpu_relax();
+			}
+			spins.store(average + (max_spins - average) / 8, std::memory_order_relaxed);
+		}
+
+		// 标记为有等待者后再睡眠，释放者看到 contended 会唤醒一个线程
+		// 被唤醒的线程同样以 contended 加锁，无法确定是否还有其他睡眠的线程
+		while (state.exchange(contended, std::memory_order_acquire) != unlocked)
+			wait(contended);
+	}
+
+	// state 仍为 value 时睡眠，可能虚假唤醒
+	void wait(uint32_t value)
+	{
+#if __linux__
+		syscall(SYS_futex, reinterpret_cast<uint32_t *>(&state), FUTEX_WAIT_PRIVATE, value, nullptr, nullptr, 0);
+#elif _WIN32
+		WaitOnAddress(&state, &value, sizeof(value), INFINITE);
+#else
+		(void)value;
+		std::this_thread::yield();
+#endif
+	}
+
+	void wake_one()
+	{
+#if __linux__
+		syscall(SYS_futex, reinterpret_cast<uint32_t *>(&state), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#elif _WIN32
+		WakeByAddressSingle(&state);
+#endif
+	}
+
+	static bool multi_core()
+	{
+		static const bool value = std::thread::hardware_concurrency() > 1;
+		return value;
+	}
+
+	constexpr static uint32_t unlocked = 0;
+	constexpr static uint32_t locked = 1;
+	constexpr static uint32_t contended = 2;
+	constexpr static int32_t max_adaptive_spins = 100;
+
+	static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex requires a plain 32-bit word");
+
+	std::atomic<uint32_t> state{ unlocked };
+	std::atomic<int32_t> spins{ 0 };
+};
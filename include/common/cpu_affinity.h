@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#if _WIN32
+// 避免 Windows.h 定义的 min/max 宏破坏 std::min/std::max
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#elif __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#endif
+
+// 当前进程可以使用的 CPU 编号
+inline std::vector<int> online_cpus()
+{
+	std::vector<int> cpus;
+#if __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (sched_getaffinity(0, sizeof(set), &set) == 0)
+	{
+		for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+			if (CPU_ISSET(cpu, &set))
+				cpus.push_back(cpu);
+	}
+#endif
+	if (cpus.empty())
+	{
+		unsigned count = std::thread::hardware_concurrency();
+		for (unsigned cpu = 0; cpu < count; ++cpu)
+			cpus.push_back(static_cast<int>(cpu));
+	}
+	return cpus;
+}
+
+// CPU 所在的 NUMA 节点，无法获取时返回 0
+inline int numa_node_of_cpu(int cpu)
+{
+#if _WIN32
+	UCHAR node = 0;
+	if (cpu < 64 && GetNumaProcessorNode(static_cast<UCHAR>(cpu), &node) && node != 0xFF)
+		return node;
+#elif __linux__
+	char path[64];
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+	if (DIR *dir = opendir(path))
+	{
+		int node = -1;
+		while (dirent *entry = readdir(dir))
+		{
+			if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9')
+			{
+				node = atoi(entry->d_name + 4);
+				break;
+			}
+		}
+		closedir(dir);
+		if (node >= 0)
+			return node;
+	}
+#else
+	(void)cpu;
+#endif
+	return 0;
+}
+
+// 将线程绑定到指定的 CPU 集合，cpus 为空时不做处理；不支持的平台返回 false
+inline bool set_thread_affinity(std::thread::native_handle_type handle, const std::vector<int> &cpus)
+{
+	if (cpus.empty())
+		return true;
+
+#if _WIN32
+	DWORD_PTR mask = 0;
+	for (int cpu : cpus)
+		if (cpu >= 0 && cpu < static_cast<int>(sizeof(DWORD_PTR) * 8))
+			mask |= static_cast<DWORD_PTR>(1) << cpu;
+	return mask != 0 && SetThreadAffinityMask(handle, mask) != 0;
+#elif __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int cpu : cpus)
+		if (cpu >= 0 && cpu < CPU_SETSIZE)
+			CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(handle, sizeof(set), &set) == 0;
+#else
+	(void)handle;
+	return false;
+#endif
+}
+
+inline bool set_thread_affinity(std::thread &thread, const std::vector<int> &cpus)
+{
+	return set_thread_affinity(thread.native_handle(), cpus);
+}
+
+inline bool set_current_thread_affinity(const std::vector<int> &cpus)
+{
+#if _WIN32
+	return set_thread_affinity(GetCurrentThread(), cpus);
+#elif __linux__
+	return set_thread_affinity(pthread_self(), cpus);
+#else
+	(void)cpus;
+	return false;
+#endif
+}
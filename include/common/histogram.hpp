@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// 无锁的延迟直方图（HDR 风格）：按 2 的幂分段，每段再均分为 2^sub_bucket_bits 个子桶，相对误差不超过 1/2^sub_bucket_bits
+// record 只做几次 relaxed 原子加，可以在多个线程中同时调用
+class latency_histogram
+{
+public:
+	static constexpr unsigned sub_bucket_bits = 3;
+	static constexpr size_t sub_bucket_count = size_t(1) << sub_bucket_bits;
+	static constexpr size_t bucket_count = (64 - sub_bucket_bits + 1) * sub_bucket_count;
+
+	struct snapshot
+	{
+		uint64_t count = 0;
+		uint64_t sum = 0;
+		uint64_t max = 0;
+		std::vector<uint64_t> buckets;
+
+		double mean() const
+		{
+			return count ? static_cast<double>(sum) / static_cast<double>(count) : 0.0;
+		}
+
+		// 返回不小于 percent% 样本的值所在桶的上界，percent 取值 [0, 100]
+		uint64_t percentile(double percent) const
+		{
+			if (count == 0)
+				return 0;
+
+			uint64_t rank = static_cast<uint64_t>(percent / 100.0 * static_cast<double>(count) + 0.5);
+			if (rank == 0)
+				rank = 1;
+
+			uint64_t seen = 0;
+			for (size_t i = 0; i < buckets.size(); ++i)
+			{
+				seen += buckets[i];
+				if (seen >= rank)
+					return std::min(bucket_upper(i), max);
+			}
+			return max;
+		}
+
+		void merge(const snapshot &other)
+		{
+			if (buckets.size() < other.buckets.size())
+				buckets.resize(other.buckets.size());
+			for (size_t i = 0; i < other.buckets.size(); ++i)
+				buckets[i] += other.buckets[i];
+			count += other.count;
+			sum += other.sum;
+			max = std::max(max, other.max);
+		}
+	};
+
+	latency_histogram() = default;
+	latency_histogram(const latency_histogram &) = delete;
+	latency_histogram& operator=(const latency_histogram &) = delete;
+
+	void record(uint64_t value) noexcept
+	{
+		buckets[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+		total.fetch_add(1, std::memory_order_relaxed);
+		sum.fetch_add(value, std::memory_order_relaxed);
+
+		uint64_t current = max.load(std::memory_order_relaxed);
+		while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed))
+			;
+	}
+
+	// 只有一个线程写入（或写入方已经互斥）时使用，不需要原子读改写
+	void record_single_writer(uint64_t value) noexcept
+	{
+		std::atomic<uint64_t> &bucket = buckets[bucket_index(value)];
+		bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		total.store(total.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		sum.store(sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+		if (value > max.load(std::memory_order_relaxed))
+			max.store(value, std::memory_order_relaxed);
+	}
+
+	// 与 record 并发时各字段之间不保证一致，count 以各桶之和为准
+	snapshot get_snapshot() const
+	{
+		snapshot res;
+		res.buckets.resize(bucket_count);
+		for (size_t i = 0; i < bucket_count; ++i)
+		{
+			res.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+			res.count += res.buckets[i];
+		}
+		res.sum = sum.load(std::memory_order_relaxed);
+		res.max = max.load(std::memory_order_relaxed);
+		return res;
+	}
+
+	uint64_t count() const noexcept
+	{
+		return total.load(std::memory_order_relaxed);
+	}
+
+	void reset() noexcept
+	{
+		for (auto &bucket : buckets)
+			bucket.store(0, std::memory_order_relaxed);
+		total.store(0, std::memory_order_relaxed);
+		sum.store(0, std::memory_order_relaxed);
+		max.store(0, std::memory_order_relaxed);
+	}
+
+	static size_t bucket_index(uint64_t value) noexcept
+	{
+		if (value < sub_bucket_count)
+			return static_cast<size_t>(value);
+
+		unsigned shift = highest_bit(value) - sub_bucket_bits;
+		return (shift + 1) * sub_bucket_count + static_cast<size_t>((value >> shift) - sub_bucket_count);
+	}
+
+	// 桶内的最大值
+	static uint64_t bucket_upper(size_t index) noexcept
+	{
+		if (index < sub_bucket_count)
+			return index;
+
+		unsigned shift = static_cast<unsigned>(index / sub_bucket_count - 1);
+		uint64_t lower = static_cast<uint64_t>(sub_bucket_count + index % sub_bucket_count) << shift;
+		return lower + ((uint64_t(1) << shift) - 1);
+	}
+
+	// 最高的 1 所在的位，value 不能为 0
+	static unsigned highest_bit(uint64_t value) noexcept
+	{
+#if defined(_MSC_VER) && defined(_WIN64)
+		unsigned long index = 0;
+		_BitScanReverse64(&index, value);
+		return static_cast<unsigned>(index);
+#elif defined(__GNUC__) || defined(__clang__)
+		return 63 - static_cast<unsigned>(__builtin_clzll(value));
+#else
+		unsigned index = 0;
+		while (value >>= 1)
+			++index;
+		return index;
+#endif
+	}
+
+private:
+	std::atomic<uint64_t> buckets[bucket_count] = {};
+	std::atomic<uint64_t> total{ 0 };
+	std::atomic<uint64_t> sum{ 0 };
+	std::atomic<uint64_t> max{ 0 };
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <stdexcept>
+
+#include "spin_lock.h"
+
+// MCS 队列锁，先进先出，每个等待者只在自己的节点上自旋，释放时只写下一个等待者的节点
+// 节点来自当前线程的固定数组，一个线程最多同时持有 max_nested 把 mcs_lock，不需要分配内存
+// 与 ticket_lock 一样，线程数超过核数时吞吐量低于 spin_lock
+class mcs_lock
+{
+public:
+	constexpr static uint32_t max_nested = 32;
+
+	mcs_lock() = default;
+	mcs_lock(const mcs_lock &) = delete;
+	mcs_lock(mcs_lock &&) = delete;
+	mcs_lock& operator=(const mcs_lock &) = delete;
+
+	void lock()
+	{
+		node *current = acquire_node();
+		current->next.store(nullptr, std::memory_order_relaxed);
+		current->locked.store(true, std::memory_order_relaxed);
+
+		node *prev = tail.exchange(current, std::memory_order_acq_rel);
+		if (prev)
+		{
+			// 排到 prev 后面，等 prev 释放时清除 locked
+			prev->next.store(current, std::memory_order_release);
+			spin_backoff backoff;
+			while (current->locked.load(std::memory_order_acquire))
+				backoff.pause();
+		}
+		owner = current;
+	}
+
+	bool try_lock()
+	{
+		if (tail.load(std::memory_order_relaxed))
+			return false;
+
+		node *current = acquire_node();
+		current->next.store(nullptr, std::memory_order_relaxed);
+
+		node *expected = nullptr;
+		if (!tail.compare_exchange_strong(expected, current, std::memory_order_acquire, std::memory_order_relaxed))
+		{
+			release_node(current);
+			return false;
+		}
+		owner = current;
+		return true;
+	}
+
+	void unlock()
+	{
+		node *current = owner;
+		node *next = current->next.load(std::memory_order_acquire);
+		if (!next)
+		{
+			// 没有等待者时直接清空队列
+			node *expected = current;
+			if (tail.compare_exchange_strong(expected, nullptr, std::memory_order_release, std::memory_order_relaxed))
+			{
+				release_node(current);
+				return;
+			}
+
+			// 新的等待者已经换下 tail，但还没有链接到 current 后面
+			while (!(next = current->next.load(std::memory_order_acquire)))
+				cpu_relax();
+		}
+
+		next->locked.store(false, std::memory_order_release);
+		// 后继者拿到锁后不会再访问 current，可以立即复用
+		release_node(current);
+	}
+
+private:
+	struct alignas(cache_line_size) node
+	{
+		std::atomic<node*> next{ nullptr };
+		std::atomic<bool> locked{ false };
+		node *free_next = nullptr;
+	};
+
+	struct node_cache
+	{
+		node_cache()
+		{
+			for (uint32_t i = 0; i < max_nested; ++i)
+				nodes[i].free_next = i + 1 < max_nested ? &nodes[i + 1] : nullptr;
+			free = nodes;
+		}
+
+		node nodes[max_nested];
+		node *free;
+	};
+
+	static node_cache& local_cache()
+	{
+		thread_local node_cache cache;
+		return cache;
+	}
+
+	static node* acquire_node()
+	{
+		node_cache &cache = local_cache();
+		node *n = cache.free;
+		if (!n)
+			throw std::runtime_error("mcs_lock: too many locks held by one thread");
+		cache.free = n->free_next;
+		return n;
+	}
+
+	// 只有加锁的线程会释放节点，所以节点总是回到它所属线程的缓存
+	static void release_node(node *n)
+	{
+		node_cache &cache = local_cache();
+		n->free_next = cache.free;
+		cache.free = n;
+	}
+
+	std::atomic<node*> tail{ nullptr };
+	// 只有持有者读写
+	node *owner = nullptr;
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+
+#include "spin_lock.h"
+
+// 读写自旋锁，接口同 std::shared_mutex，可以用于 std::shared_lock/std::unique_lock
+// 默认读优先，读者不断时写者可能一直拿不到锁；prefer_writer 为 true 时有写者在等待，新的读者就不再进入
+// 所有读者都修改同一个计数，读多写少但读者很多、临界区很短时用 seqlock
+class rw_spin_lock
+{
+public:
+	explicit rw_spin_lock(bool prefer_writer = false)
+		: prefer_writer(prefer_writer)
+	{
+	}
+	rw_spin_lock(const rw_spin_lock &) = delete;
+	rw_spin_lock(rw_spin_lock &&) = delete;
+	rw_spin_lock& operator=(const rw_spin_lock &) = delete;
+
+	void lock()
+	{
+		uint32_t current = 0;
+		if (state.compare_exchange_strong(current, writer, std::memory_order_acquire, std::memory_order_relaxed))
+			return;
+
+		// 登记为等待中的写者，拿到锁时再去掉
+		uint32_t waiting = 0;
+		if (prefer_writer)
+		{
+			state.fetch_add(waiting_writer, std::memory_order_relaxed);
+			waiting = waiting_writer;
+		}
+
+		spin_backoff backoff;
+		for (;;)
+		{
+			current = state.load(std::memory_order_relaxed);
+			if ((current & ~waiting_mask) == 0)
+			{
+				if (state.compare_exchange_weak(current, current - waiting + writer, std::memory_order_acquire, std::memory_order_relaxed))
+					return;
+				continue;
+			}
+			backoff.pause();
+		}
+	}
+
+	bool try_lock()
+	{
+		uint32_t current = state.load(std::memory_order_relaxed);
+		return (current & ~waiting_mask) == 0 &&
+			state.compare_exchange_strong(current, current + writer, std::memory_order_acquire, std::memory_order_relaxed);
+	}
+
+	void unlock()
+	{
+		state.fetch_sub(writer, std::memory_order_release);
+	}
+
+	void lock_shared()
+	{
+		for (;;)
+		{
+			// 先直接加上读者计数，没有写者时一次原子操作即可，有写者时撤回再等
+			if (!(state.fetch_add(reader, std::memory_order_acquire) & reader_blocked))
+				return;
+			state.fetch_sub(reader, std::memory_order_relaxed);
+
+			spin_backoff backoff;
+			while (state.load(std::memory_order_relaxed) & reader_blocked)
+				backoff.pause();
+		}
+	}
+
+	bool try_lock_shared()
+	{
+		uint32_t current = state.load(std::memory_order_relaxed);
+		return !(current & reader_blocked) &&
+			state.compare_exchange_strong(current, current + reader, std::memory_order_acquire, std::memory_order_relaxed);
+	}
+
+	void unlock_shared()
+	{
+		state.fetch_sub(reader, std::memory_order_release);
+	}
+
+private:
+	// 最低位为写者，1~15 位为等待中的写者数，高 16 位为读者数
+	constexpr static uint32_t writer = 1;
+	constexpr static uint32_t waiting_writer = 2;
+	constexpr static uint32_t waiting_mask = 0xfffe;
+	constexpr static uint32_t reader = 0x10000;
+	constexpr static uint32_t reader_blocked = writer | waiting_mask;
+
+	std::atomic<uint32_t> state{ 0 };
+	const bool prefer_writer;
+};
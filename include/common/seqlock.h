@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <type_traits>
+
+#include "spin_lock.h"
+
+// 顺序锁，保存一个可平凡复制的小对象，读者不写任何共享数据，读的开销不随读者数增加
+// 写者之间用 spin_lock 互斥，写入期间序号为奇数，读者发现序号变化就重读，写得频繁时读者可能反复重试
+// 数据按字存成 relaxed 原子变量，读到写了一半的值也不是数据竞争，校验序号后才转换回 T
+template<class T>
+class seqlock
+{
+	static_assert(std::is_trivially_copyable<T>::value, "seqlock requires a trivially copyable type");
+	static_assert(std::is_default_constructible<T>::value, "seqlock requires a default constructible type");
+
+public:
+	explicit seqlock(const T &value = T())
+	{
+		write_words(value);
+	}
+	seqlock(const seqlock &) = delete;
+	seqlock(seqlock &&) = delete;
+	seqlock& operator=(const seqlock &) = delete;
+
+	T load() const
+	{
+		word buffer[word_count];
+		spin_backoff backoff;
+		for (;;)
+		{
+			uint32_t begin = sequence.load(std::memory_order_acquire);
+			if (!(begin & 1))
+			{
+				for (size_t i = 0; i < word_count; ++i)
+					buffer[i] = words[i].load(std::memory_order_relaxed);
+				// 保证上面的读取不会重排到下面校验序号之后
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (sequence.load(std::memory_order_relaxed) == begin)
+					break;
+			}
+			backoff.pause();
+		}
+
+		T value;
+		std::memcpy(&value, buffer, sizeof(T));
+		return value;
+	}
+
+	void store(const T &value)
+	{
+		std::lock_guard<spin_lock> lock(write_lock);
+		begin_write();
+		write_words(value);
+		end_write();
+	}
+
+	// 在写锁内用 f(T &) 修改当前值，适合只改动几个字段
+	template<class F>
+	void update(F &&f)
+	{
+		std::lock_guard<spin_lock> lock(write_lock);
+		// 写者互斥，这里读到的一定是完整的值
+		word buffer[word_count];
+		for (size_t i = 0; i < word_count; ++i)
+			buffer[i] = words[i].load(std::memory_order_relaxed);
+		T value;
+		std::memcpy(&value, buffer, sizeof(T));
+		f(value);
+
+		begin_write();
+		write_words(value);
+		end_write();
+	}
+
+private:
+	using word = uintptr_t;
+	constexpr static size_t word_count = (sizeof(T) + sizeof(word) - 1) / sizeof(word);
+
+	void begin_write()
+	{
+		sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		// 保证序号先于数据被读者看到
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+
+	void end_write()
+	{
+		sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	void write_words(const T &value)
+	{
+		word buffer[word_count] = {};
+		std::memcpy(buffer, &value, sizeof(T));
+		for (size_t i = 0; i < word_count; ++i)
+			words[i].store(buffer[i], std::memory_order_relaxed);
+	}
+
+	std::atomic<uint32_t> sequence{ 0 };
+	spin_lock write_lock;
+	std::atomic<word> words[word_count];
+};
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+// 只能移动的 std::function，可调用对象不超过 Capacity 时直接存放在对象内部，不分配内存
+template<class Signature, size_t Capacity = 4 * sizeof(void *)>
+class small_function;
+
+template<class R, class... Args, size_t Capacity>
+class small_function<R(Args...), Capacity>
+{
+	struct operations
+	{
+		R(*invoke)(void *storage, Args &&... args);
+		// 从 src 移动构造到 dst，并析构 src
+		void(*relocate)(void *dst, void *src) noexcept;
+		void(*destroy)(void *storage) noexcept;
+	};
+
+	template<class F>
+	struct inline_operations
+	{
+		static R invoke(void *storage, Args &&... args)
+		{
+			return (*static_cast<F *>(storage))(std::forward<Args>(args)...);
+		}
+
+		static void relocate(void *dst, void *src) noexcept
+		{
+			::new (dst) F(std::move(*static_cast<F *>(src)));
+			static_cast<F *>(src)->~F();
+		}
+
+		static void destroy(void *storage) noexcept
+		{
+			static_cast<F *>(storage)->~F();
+		}
+
+		static constexpr operations table{ &invoke, &relocate, &destroy };
+	};
+
+	// 超出 Capacity 的可调用对象在堆上分配，内部只保存指针
+	template<class F>
+	struct heap_operations
+	{
+		static R invoke(void *storage, Args &&... args)
+		{
+			return (**static_cast<F **>(storage))(std::forward<Args>(args)...);
+		}
+
+		static void relocate(void *dst, void *src) noexcept
+		{
+			*static_cast<F **>(dst) = *static_cast<F **>(src);
+		}
+
+		static void destroy(void *storage) noexcept
+		{
+			delete *static_cast<F **>(storage);
+		}
+
+		static constexpr operations table{ &invoke, &relocate, &destroy };
+	};
+
+	template<class F>
+	using enable_if_callable = std::enable_if_t<!std::is_same<std::decay_t<F>, small_function>::value && !std::is_same<std::decay_t<F>, std::nullptr_t>::value, int>;
+
+public:
+	template<class F>
+	static constexpr bool is_stored_inline = sizeof(F) <= Capacity
+		&& alignof(F) <= alignof(std::max_align_t)
+		&& std::is_nothrow_move_constructible<F>::value;
+
+	small_function() noexcept = default;
+
+	small_function(std::nullptr_t) noexcept {}
+
+	template<class F, enable_if_callable<F> = 0>
+	small_function(F &&f)
+	{
+		construct(std::forward<F>(f));
+	}
+
+	small_function(small_function &&other) noexcept
+	{
+		move_from(other);
+	}
+
+	small_function(const small_function &) = delete;
+	small_function& operator=(const small_function &) = delete;
+
+	small_function& operator=(small_function &&other) noexcept
+	{
+		if (this != &other)
+		{
+			reset();
+			move_from(other);
+		}
+		return *this;
+	}
+
+	small_function& operator=(std::nullptr_t) noexcept
+	{
+		reset();
+		return *this;
+	}
+
+	template<class F, enable_if_callable<F> = 0>
+	small_function& operator=(F &&f)
+	{
+		reset();
+		construct(std::forward<F>(f));
+		return *this;
+	}
+
+	~small_function()
+	{
+		reset();
+	}
+
+	explicit operator bool() const noexcept { return ops != nullptr; }
+
+	R operator()(Args... args)
+	{
+		return ops->invoke(&storage, std::forward<Args>(args)...);
+	}
+
+	void reset() noexcept
+	{
+		if (ops)
+		{
+			ops->destroy(&storage);
+			ops = nullptr;
+		}
+	}
+
+private:
+	template<class F>
+	void construct(F &&f)
+	{
+		using func_type = std::decay_t<F>;
+		construct_impl<func_type>(std::forward<F>(f), std::integral_constant<bool, is_stored_inline<func_type>>());
+	}
+
+	template<class T, class F>
+	void construct_impl(F &&f, std::true_type)
+	{
+		::new (static_cast<void *>(&storage)) T(std::forward<F>(f));
+		ops = &inline_operations<T>::table;
+	}
+
+	template<class T, class F>
+	void construct_impl(F &&f, std::false_type)
+	{
+		*reinterpret_cast<T **>(&storage) = new T(std::forward<F>(f));
+		ops = &heap_operations<T>::table;
+	}
+
+	void move_from(small_function &other) noexcept
+	{
+		if (other.ops)
+		{
+			other.ops->relocate(&storage, &other.storage);
+			ops = other.ops;
+			other.ops = nullptr;
+		}
+	}
+
+private:
+	const operations *ops = nullptr;
+	typename std::aligned_storage<Capacity < sizeof(void *) ? sizeof(void *) : Capacity, alignof(std::max_align_t)>::type storage;
+};
+
+template<class R, class... Args, size_t Capacity>
+template<class F>
+constexpr typename small_function<R(Args...), Capacity>::operations small_function<R(Args...), Capacity>::inline_operations<F>::table;
+
+template<class R, class... Args, size_t Capacity>
+template<class F>
+constexpr typename small_function<R(Args...), Capacity>::operations small_function<R(Args...), Capacity>::heap_operations<F>::table;
@@ -4,9 +4,57 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <atomic>
 #include <thread>
 
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#endif
+
+// 自旋等待时提示 CPU 降低功耗、让出流水线给同一核心上的另一个超线程，不会让出时间片
+inline void cpu_relax() noexcept
+{
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+	_mm_pause();
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__i386__) || defined(__x86_64__))
+	__builtin_ia32_pause();
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__aarch64__) || defined(__arm__))
+	__asm__ __volatile__("yield" ::: "memory");
+#else
+	std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+// 缓存行大小，std::hardware_destructive_interference_size 需要 C++17 且 GCC 会对在头文件中使用它给出警告，x86 与常见 ARM 上都是 64
+constexpr size_t cache_line_size = 64;
+
+// 自旋等待的退避：先指数增加 pause 的次数，持有者长时间不释放时（例如被调度出去）才让出时间片
+class spin_backoff
+{
+public:
+	void pause()
+	{
+		if (count <= max_count)
+		{
+			for (uint32_t i = 0; i < count; i++)
+				cpu_relax();
+			count <<= 1;
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+
+private:
+	constexpr static uint32_t max_count = 64;
+
+	uint32_t count = 1;
+};
+
+// test-and-test-and-set，锁被占用时只读等待，释放后才再次尝试写入，等待者不会反复抢占缓存行
 class spin_lock
 {
 public:
@@ -17,29 +65,32 @@ public:
 
 	void lock()
 	{
-		uint8_t backoff = 1;
+		spin_backoff backoff;
 
-		while (flag.test_and_set(std::memory_order_acquire))
+		while (flag.exchange(true, std::memory_order_acquire))
 		{
-			for (uint8_t i = 0; i < backoff; i++)
-				std::this_thread::yield();
-			if (backoff < max_back_off)
-				backoff <<= 1;
+			do
+			{
+				backoff.pause();
+			} while (flag.load(std::memory_order_relaxed));
 		}
 	}
 
 	bool try_lock()
 	{
-		return !flag.test_and_set(std::memory_order_acquire);
+		return !flag.load(std::memory_order_relaxed) && !flag.exchange(true, std::memory_order_acquire);
 	}
 
 	void unlock()
 	{
-		flag.clear(std::memory_order_release);
+		flag.store(false, std::memory_order_release);
 	}
 
 private:
-	constexpr static uint8_t max_back_off = 16;
+	std::atomic<bool> flag{ false };
+};
 
-	std::atomic_flag flag = ATOMIC_FLAG_INIT;
+// 独占一个缓存行的 spin_lock，放在数组或与频繁写入的数据相邻时避免伪共享；C++17 之前用 new 动态分配时不保证对齐
+class alignas(cache_line_size) padded_spin_lock : public spin_lock
+{
 };
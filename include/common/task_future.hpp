@@ -0,0 +1,614 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <future>
+#include <chrono>
+#include <new>
+#include <utility>
+#include <functional>
+#include <type_traits>
+#include <atomic>
+#include <vector>
+#include <tuple>
+#include <iterator>
+
+#include "small_function.hpp"
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define TASK_FUTURE_HAS_COROUTINE 1
+#endif
+#endif
+
+#ifndef TASK_FUTURE_HAS_COROUTINE
+#define TASK_FUTURE_HAS_COROUTINE 0
+#endif
+
+template<class T>
+class task_future;
+
+// task_promise 与 task_future 之间的共享状态，结果就绪时执行注册的回调（只能有一个）
+template<class T>
+class task_shared_state
+{
+	using storage_type = std::conditional_t<std::is_void<T>::value, char,
+		std::conditional_t<std::is_reference<T>::value, std::reference_wrapper<std::remove_reference_t<T>>, T>>;
+
+public:
+	task_shared_state() = default;
+	task_shared_state(const task_shared_state &) = delete;
+	task_shared_state& operator=(const task_shared_state &) = delete;
+
+	~task_shared_state()
+	{
+		if (has_value)
+			value()->~storage_type();
+	}
+
+	template<class... Args>
+	void set_value(Args&&... args)
+	{
+		small_function<void()> callback;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (ready)
+				throw std::future_error(std::future_errc::promise_already_satisfied);
+
+			::new (static_cast<void *>(&storage)) storage_type(std::forward<Args>(args)...);
+			has_value = true;
+			ready = true;
+			callback = std::move(continuation);
+		}
+		condition.notify_all();
+		if (callback)
+			callback();
+	}
+
+	void set_exception(std::exception_ptr exception)
+	{
+		small_function<void()> callback;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (ready)
+				throw std::future_error(std::future_errc::promise_already_satisfied);
+
+			error = std::move(exception);
+			ready = true;
+			callback = std::move(continuation);
+		}
+		condition.notify_all();
+		if (callback)
+			callback();
+	}
+
+	bool is_ready()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return ready;
+	}
+
+	// 结果未就绪时保存回调并返回 true，已就绪时返回 false，不调用回调
+	bool set_continuation(small_function<void()> &callback)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (ready)
+			return false;
+
+		continuation = std::move(callback);
+		return true;
+	}
+
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		condition.wait(lock, [this] { return ready; });
+	}
+
+	template<class Clock, class Duration>
+	std::future_status wait_until(const std::chrono::time_point<Clock, Duration> &time)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		return condition.wait_until(lock, time, [this] { return ready; }) ? std::future_status::ready : std::future_status::timeout;
+	}
+
+	// 阻塞到结果就绪，只能调用一次
+	T get()
+	{
+		wait();
+		if (error)
+			std::rethrow_exception(error);
+		return take(std::is_void<T>());
+	}
+
+private:
+	storage_type *value()
+	{
+		return reinterpret_cast<storage_type *>(&storage);
+	}
+
+	void take(std::true_type) {}
+
+	T take(std::false_type)
+	{
+		return static_cast<T>(std::move(*value()));
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool ready = false;
+	bool has_value = false;
+	typename std::aligned_storage<sizeof(storage_type), alignof(storage_type)>::type storage;
+	std::exception_ptr error;
+	small_function<void()> continuation;
+};
+
+// 与 std::promise 类似，未设置结果就析构时 task_future 得到 broken_promise
+template<class T>
+class task_promise
+{
+public:
+	task_promise() : state(std::make_shared<task_shared_state<T>>()) {}
+
+	task_promise(task_promise &&other) noexcept = default;
+
+	task_promise& operator=(task_promise &&other) noexcept
+	{
+		if (this != &other)
+		{
+			abandon();
+			state = std::move(other.state);
+			retrieved = other.retrieved;
+		}
+		return *this;
+	}
+
+	task_promise(const task_promise &) = delete;
+	task_promise& operator=(const task_promise &) = delete;
+
+	~task_promise()
+	{
+		abandon();
+	}
+
+	task_future<T> get_future()
+	{
+		if (!state)
+			throw std::future_error(std::future_errc::no_state);
+		if (retrieved)
+			throw std::future_error(std::future_errc::future_already_retrieved);
+
+		retrieved = true;
+		return task_future<T>(state);
+	}
+
+	template<class... Args>
+	void set_value(Args&&... args)
+	{
+		if (!state)
+			throw std::future_error(std::future_errc::no_state);
+		state->set_value(std::forward<Args>(args)...);
+	}
+
+	void set_exception(std::exception_ptr exception)
+	{
+		if (!state)
+			throw std::future_error(std::future_errc::no_state);
+		state->set_exception(std::move(exception));
+	}
+
+	// 执行 f 并保存返回值或异常
+	template<class F>
+	void set_result_of(F &f)
+	{
+		try
+		{
+			invoke(f, std::is_void<T>());
+		}
+		catch (...)
+		{
+			set_exception(std::current_exception());
+		}
+	}
+
+private:
+	template<class F>
+	void invoke(F &f, std::true_type)
+	{
+		f();
+		set_value();
+	}
+
+	template<class F>
+	void invoke(F &f, std::false_type)
+	{
+		set_value(f());
+	}
+
+	void abandon()
+	{
+		if (state && !state->is_ready())
+			state->set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+	}
+
+private:
+	std::shared_ptr<task_shared_state<T>> state;
+	bool retrieved = false;
+};
+
+#if TASK_FUTURE_HAS_COROUTINE
+// 返回 task_future 的协程立即开始执行，co_return 的值通过 task_future 获取
+template<class T>
+struct task_coroutine_promise
+{
+	task_promise<T> promise;
+
+	void return_value(T value)
+	{
+		promise.set_value(std::forward<T>(value));
+	}
+
+	void unhandled_exception()
+	{
+		promise.set_exception(std::current_exception());
+	}
+};
+
+template<>
+struct task_coroutine_promise<void>
+{
+	task_promise<void> promise;
+
+	void return_void()
+	{
+		promise.set_value();
+	}
+
+	void unhandled_exception()
+	{
+		promise.set_exception(std::current_exception());
+	}
+};
+#endif
+
+// 以 Arg 调用 f 的副本的返回值，std::result_of 在 C++20 中已移除
+template<class F, class Arg>
+using continuation_result_t = decltype(std::declval<std::decay_t<F> &>()(std::declval<Arg>()));
+
+// 与 std::future 接口相同，C++20 下还可以 co_await，结果就绪后协程在设置结果的线程中继续执行
+template<class T>
+class task_future
+{
+	friend class task_promise<T>;
+
+	explicit task_future(std::shared_ptr<task_shared_state<T>> state) : state(std::move(state)) {}
+
+public:
+	task_future() noexcept = default;
+	task_future(task_future &&) noexcept = default;
+	task_future& operator=(task_future &&) noexcept = default;
+	task_future(const task_future &) = delete;
+	task_future& operator=(const task_future &) = delete;
+
+	bool valid() const noexcept
+	{
+		return state != nullptr;
+	}
+
+	bool is_ready() const
+	{
+		return checked_state()->is_ready();
+	}
+
+	// 阻塞到结果就绪并取出结果，之后 valid() 为 false
+	T get()
+	{
+		checked_state();
+		std::shared_ptr<task_shared_state<T>> current = std::move(state);
+		return current->get();
+	}
+
+	void wait() const
+	{
+		checked_state()->wait();
+	}
+
+	template<class Rep, class Period>
+	std::future_status wait_for(const std::chrono::duration<Rep, Period> &duration) const
+	{
+		return checked_state()->wait_until(std::chrono::steady_clock::now() + duration);
+	}
+
+	template<class Clock, class Duration>
+	std::future_status wait_until(const std::chrono::time_point<Clock, Duration> &time) const
+	{
+		return checked_state()->wait_until(time);
+	}
+
+	// 兼容原来返回 std::future 的接口，结果就绪时转交给 std::promise
+	operator std::future<T>() &&
+	{
+		std::promise<T> promise;
+		std::future<T> res = promise.get_future();
+		continue_with([promise = std::move(promise)](task_future ready) mutable {
+			forward_result(ready, promise, std::is_void<T>());
+		});
+		return res;
+	}
+
+	// 结果就绪时在设置结果的线程中调用 callback，已经就绪时立即调用；不取走结果
+	// 每个 task_future 只能有一个回调，then、co_await 也会占用这个位置
+	void on_ready(small_function<void()> callback)
+	{
+		if (!checked_state()->set_continuation(callback))
+			callback();
+	}
+
+	// 结果就绪后以就绪的 task_future 调用 f，返回 f 的结果；f 在设置结果的线程中执行，之后本对象失效
+	template<class F>
+	auto then(F &&f) -> task_future<continuation_result_t<F, task_future>>
+	{
+		using result_type = continuation_result_t<F, task_future>;
+
+		task_promise<result_type> promise;
+		task_future<result_type> res = promise.get_future();
+		continue_with([promise = std::move(promise), f = std::forward<F>(f)](task_future ready) mutable {
+			auto call = [&] { return f(std::move(ready)); };
+			promise.set_result_of(call);
+		});
+		return res;
+	}
+
+	// 同上，但 f 作为任务提交到 executor（例如 ThreadPool）的分组中执行，不占用设置结果的线程
+	// executor 需要比结果先就绪的任务存活更久；提交失败（分组不存在、队列已满）时返回的 task_future 得到 broken_promise
+	template<class Executor, class F>
+	auto then(Executor &executor, uint32_t group_id, F &&f) -> task_future<continuation_result_t<F, task_future>>
+	{
+		using result_type = continuation_result_t<F, task_future>;
+
+		task_promise<result_type> promise;
+		task_future<result_type> res = promise.get_future();
+		continue_with([&executor, group_id, promise = std::move(promise), f = std::forward<F>(f)](task_future ready) mutable {
+			try
+			{
+				executor.post(group_id, [promise = std::move(promise), f = std::move(f), ready = std::move(ready)]() mutable {
+					auto call = [&] { return f(std::move(ready)); };
+					promise.set_result_of(call);
+				});
+			}
+			catch (...)
+			{
+				// 任务随异常一起销毁，promise 析构时设置 broken_promise
+			}
+		});
+		return res;
+	}
+
+#if TASK_FUTURE_HAS_COROUTINE
+	struct promise_type : task_coroutine_promise<T>
+	{
+		task_future get_return_object()
+		{
+			return this->promise.get_future();
+		}
+
+		std::suspend_never initial_suspend() const noexcept { return {}; }
+		std::suspend_never final_suspend() const noexcept { return {}; }
+	};
+
+	bool await_ready() const
+	{
+		return checked_state()->is_ready();
+	}
+
+	bool await_suspend(std::coroutine_handle<> handle)
+	{
+		// 回调可能在其他线程中立即恢复协程并销毁本对象，因此持有共享状态的副本
+		std::shared_ptr<task_shared_state<T>> current = checked_state();
+		small_function<void()> resume = [handle] { handle.resume(); };
+		return current->set_continuation(resume);
+	}
+
+	T await_resume()
+	{
+		return get();
+	}
+#endif
+
+private:
+	// 结果就绪后以就绪的 task_future 调用 callback，本对象随之失效
+	template<class Callback>
+	void continue_with(Callback &&callback)
+	{
+		checked_state();
+		task_shared_state<T> &shared = *state;
+		small_function<void()> continuation = [current = std::move(state), callback = std::forward<Callback>(callback)]() mutable {
+			callback(task_future(std::move(current)));
+		};
+		if (!shared.set_continuation(continuation))
+			continuation();
+	}
+
+	static void forward_result(task_future &ready, std::promise<T> &promise, std::true_type)
+	{
+		try
+		{
+			ready.get();
+			promise.set_value();
+		}
+		catch (...)
+		{
+			promise.set_exception(std::current_exception());
+		}
+	}
+
+	static void forward_result(task_future &ready, std::promise<T> &promise, std::false_type)
+	{
+		try
+		{
+			promise.set_value(ready.get());
+		}
+		catch (...)
+		{
+			promise.set_exception(std::current_exception());
+		}
+	}
+
+	const std::shared_ptr<task_shared_state<T>> &checked_state() const
+	{
+		if (!state)
+			throw std::future_error(std::future_errc::no_state);
+		return state;
+	}
+
+private:
+	std::shared_ptr<task_shared_state<T>> state;
+};
+
+template<class Sequence>
+struct when_any_result
+{
+	// 第一个就绪的 task_future 的下标，输入为空时为 size_t(-1)
+	size_t index = static_cast<size_t>(-1);
+	Sequence futures;
+};
+
+// 所有 task_future 就绪后，返回的 task_future 得到它们（均已就绪）；不阻塞任何线程
+template<class Iter>
+auto when_all(Iter first, Iter last) -> task_future<std::vector<typename std::iterator_traits<Iter>::value_type>>
+{
+	using sequence = std::vector<typename std::iterator_traits<Iter>::value_type>;
+
+	struct context
+	{
+		sequence futures;
+		// 注册回调期间额外持有一个计数，避免回调在注册完之前取走 futures
+		std::atomic<size_t> remaining{ 1 };
+		task_promise<sequence> promise;
+
+		void done()
+		{
+			if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				promise.set_value(std::move(futures));
+		}
+	};
+
+	auto ctx = std::make_shared<context>();
+	for (; first != last; ++first)
+		ctx->futures.push_back(std::move(*first));
+
+	task_future<sequence> res = ctx->promise.get_future();
+	ctx->remaining.fetch_add(ctx->futures.size(), std::memory_order_relaxed);
+	for (auto &future : ctx->futures)
+		future.on_ready([ctx] { ctx->done(); });
+	ctx->done();
+	return res;
+}
+
+template<class Range>
+auto when_all(Range &&futures)
+{
+	using std::begin;
+	using std::end;
+	return when_all(std::make_move_iterator(begin(futures)), std::make_move_iterator(end(futures)));
+}
+
+template<class Tuple, class Callback, size_t... I>
+void on_ready_each(Tuple &futures, const Callback &callback, std::index_sequence<I...>)
+{
+	int expand[] = { 0, (std::get<I>(futures).on_ready(callback), 0)... };
+	(void)expand;
+}
+
+// 与 when_all 相同，参数为不同类型的 task_future，结果为 std::tuple
+template<class... Futures>
+auto when_all_tuple(Futures&&... futures) -> task_future<std::tuple<std::decay_t<Futures>...>>
+{
+	using sequence = std::tuple<std::decay_t<Futures>...>;
+
+	struct context
+	{
+		explicit context(Futures&&... futures) : futures(std::move(futures)...) {}
+
+		sequence futures;
+		std::atomic<size_t> remaining{ sizeof...(Futures) + 1 };
+		task_promise<sequence> promise;
+
+		void done()
+		{
+			if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				promise.set_value(std::move(futures));
+		}
+	};
+
+	auto ctx = std::make_shared<context>(std::forward<Futures>(futures)...);
+	task_future<sequence> res = ctx->promise.get_future();
+	on_ready_each(ctx->futures, [ctx] { ctx->done(); }, std::index_sequence_for<Futures...>());
+	ctx->done();
+	return res;
+}
+
+// 任意一个 task_future 就绪后，返回的 task_future 得到就绪的下标和所有 task_future；不阻塞任何线程
+template<class Iter>
+auto when_any(Iter first, Iter last) -> task_future<when_any_result<std::vector<typename std::iterator_traits<Iter>::value_type>>>
+{
+	using sequence = std::vector<typename std::iterator_traits<Iter>::value_type>;
+
+	struct context
+	{
+		sequence futures;
+		std::atomic<bool> fired{ false };
+		size_t index = static_cast<size_t>(-1);
+		// 第一个就绪的回调和注册结束各减一次，都完成后才取走 futures
+		std::atomic<size_t> gate{ 2 };
+		task_promise<when_any_result<sequence>> promise;
+
+		void ready(size_t i)
+		{
+			if (fired.exchange(true, std::memory_order_acq_rel))
+				return;
+
+			index = i;
+			pass();
+		}
+
+		void pass()
+		{
+			if (gate.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				when_any_result<sequence> result;
+				result.index = index;
+				result.futures = std::move(futures);
+				promise.set_value(std::move(result));
+			}
+		}
+	};
+
+	auto ctx = std::make_shared<context>();
+	for (; first != last; ++first)
+		ctx->futures.push_back(std::move(*first));
+
+	task_future<when_any_result<sequence>> res = ctx->promise.get_future();
+	if (ctx->futures.empty())
+	{
+		ctx->promise.set_value(when_any_result<sequence>());
+		return res;
+	}
+
+	for (size_t i = 0; i < ctx->futures.size(); ++i)
+		ctx->futures[i].on_ready([ctx, i] { ctx->ready(i); });
+	ctx->pass();
+	return res;
+}
+
+template<class Range>
+auto when_any(Range &&futures)
+{
+	using std::begin;
+	using std::end;
+	return when_any(std::make_move_iterator(begin(futures)), std::make_move_iterator(end(futures)));
+}
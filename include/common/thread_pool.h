@@ -4,62 +4,539 @@
 
 #pragma once
 
+#include <cstdint>
 #include <utility>
 #include <vector>
-#include <deque>
-#include <map>
+#include <unordered_map>
+#include <memory>
+#include <atomic>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <future>
 #include <functional>
 #include <stdexcept>
+#include <algorithm>
+#include <tuple>
+#include <iterator>
+#include <chrono>
 
-class ThreadPool
+#include "spin_lock.h"
+#include "small_function.hpp"
+#include "cpu_affinity.h"
+#include "histogram.hpp"
+#include "task_future.hpp"
+
+// 队列满时的处理策略，与 spdlog 的 async_overflow_policy 类似
+enum class ThreadPoolOverflowPolicy : uint8_t
+{
+	// 阻塞提交任务的线程，直到队列有空间
+	block,
+	// 立即拒绝新任务，post 返回 false，返回 task_future 的接口得到 ThreadPoolQueueFull 异常
+	fail_fast,
+	// 丢弃分组中最旧的任务，被丢弃任务的 task_future 得到 broken_promise
+	overrun_oldest,
+};
+
+// 任务因队列已满被拒绝，与任务被丢弃时的 broken_promise 区分
+class ThreadPoolQueueFull : public std::runtime_error
 {
 public:
-	ThreadPool(size_t threads, bool wait_on_quit = false)
-		: wait_done(wait_on_quit)
+	ThreadPoolQueueFull() : std::runtime_error("ThreadPool queue is full") {}
+};
+
+// 传给任务开始、结束回调的信息
+struct ThreadPoolTaskInfo
+{
+	uint32_t group_id = 0;
+	size_t worker = 0;
+
+	// 任务从入队到开始执行的时间
+	uint64_t wait_ns = 0;
+
+	// 任务执行时间，只在结束回调中有效
+	uint64_t exec_ns = 0;
+};
+
+struct ThreadPoolOptions
+{
+	// 初始线程数，开启弹性线程数时也是最小线程数
+	size_t threads = 1;
+
+	// 大于 threads 时开启弹性线程数：任务的排队时间超过 scale_up_wait_us 且没有空闲线程时增加线程，
+	// 线程空闲超过 idle_timeout_ms 后退出，直到剩下 threads 个
+	// 开启后另有一个监控线程每隔 scale_up_wait_us 检查一次，所有线程都被长任务占住、没有任务提交和取出时同样会增加线程
+	size_t max_threads = 0;
+	uint64_t scale_up_wait_us = 1000;
+	uint64_t idle_timeout_ms = 10000;
+
+	// 停止时是否等待队列中的任务执行完毕
+	bool wait_on_quit = false;
+
+	// 工作窃取模式：每个线程持有无锁的本地队列，批量从分组中取任务，空闲时从其他线程窃取
+	bool work_stealing = false;
+
+	// 工作窃取模式下，一次从分组中取出的最大任务数，已取到本地队列的任务不再受分组优先级影响
+	size_t steal_batch = 32;
+
+	// 线程可以运行的 CPU，为空时不设置亲和性
+	std::vector<int> cpus;
+
+	// 为 true 时第 i 个线程只绑定 cpus[i % cpus.size()]，否则所有线程共用 cpus
+	bool pin_workers = false;
+
+	// 按 NUMA 节点划分线程，每个节点有独立的就绪队列，分组可以通过 ThreadPoolGroupOptions::numa_node 绑定到节点
+	// 未绑定线程时（pin_workers 为 false），线程轮流分配到 cpus（为空时为全部 CPU）所在的各个节点，并绑定到节点的 CPU 上
+	bool numa_aware = false;
+
+	// 所有分组排队任务数的上限，0 表示不限制
+	size_t capacity = 0;
+	ThreadPoolOverflowPolicy overflow_policy = ThreadPoolOverflowPolicy::block;
+
+	// 记录每个分组、每个线程的等待时间和执行时间直方图
+	bool metrics = false;
+
+	// 每 metrics_sample 个任务记录一次等待时间和执行时间直方图（执行时间每次多取两次时钟），busy_ns 按采样放大估算；1 表示每个任务都记录
+	uint32_t metrics_sample = 16;
+
+	// 任务开始、结束时在工作线程中调用，可以用来接入 tracer；回调不能抛出异常
+	std::function<void(const ThreadPoolTaskInfo &)> on_task_begin;
+	std::function<void(const ThreadPoolTaskInfo &)> on_task_end;
+};
+
+// 分组之间严格按优先级调度，高优先级分组有任务时不会执行低优先级分组的任务
+enum class ThreadPoolPriority : uint8_t
+{
+	high,
+	normal,
+	low,
+};
+
+struct ThreadPoolGroupOptions
+{
+	// 同一优先级的分组按权重做加权轮询（deficit round robin），每轮最多连续执行 weight 个任务
+	uint32_t weight = 1;
+
+	ThreadPoolPriority priority = ThreadPoolPriority::normal;
+
+	// 串行分组，类似 asio 的 strand：同一时刻最多只有一个任务在执行，任务按入队顺序执行
+	bool serial = false;
+
+	// 绑定的 NUMA 节点，只由该节点上的线程执行；-1 或线程池未开启 numa_aware、节点上没有线程时不绑定
+	int numa_node = -1;
+
+	// 分组排队任务数的上限，0 表示不限制
+	size_t capacity = 0;
+	ThreadPoolOverflowPolicy overflow_policy = ThreadPoolOverflowPolicy::block;
+};
+
+struct ThreadPoolGroupStats
+{
+	// 当前排队的任务数
+	size_t queue_depth = 0;
+	size_t max_queue_depth = 0;
+
+	uint64_t enqueued = 0;
+	uint64_t dequeued = 0;
+
+	// 任务从入队到被线程取出的等待时间
+	uint64_t total_wait_us = 0;
+	uint64_t max_wait_us = 0;
+
+	// 提交时队列已满的次数（block 策略等待多次也只计一次），以及因此被拒绝、丢弃的任务数
+	uint64_t overflows = 0;
+	uint64_t rejected = 0;
+	uint64_t dropped = 0;
+};
+
+struct ThreadPoolStats
+{
+	// 所有分组中排队的任务数及其高水位
+	size_t pending_tasks = 0;
+	size_t max_pending_tasks = 0;
+
+	uint64_t overflows = 0;
+	uint64_t rejected = 0;
+	uint64_t dropped = 0;
+
+	// 当前因 block 策略等待的提交线程数
+	size_t blocked_producers = 0;
+
+	// 当前运行的线程数
+	size_t active_workers = 0;
+};
+
+// 以下直方图只在 ThreadPoolOptions::metrics 开启时有数据，单位为纳秒
+struct ThreadPoolWorkerMetrics
+{
+	size_t worker = 0;
+	int numa_node = 0;
+
+	// 弹性线程数下该线程是否在运行
+	bool active = false;
+
+	uint64_t executed = 0;
+
+	// 执行任务的总时间，以及占线程运行时间的比例
+	uint64_t busy_ns = 0;
+	uint64_t uptime_ns = 0;
+	double utilization = 0.0;
+
+	latency_histogram::snapshot exec_ns;
+};
+
+struct ThreadPoolGroupMetrics
+{
+	uint32_t group_id = 0;
+	ThreadPoolGroupStats stats;
+
+	// 从入队到被线程取出的等待时间，与 exec_ns 一样按 metrics_sample 采样，总任务数见 stats.dequeued
+	latency_histogram::snapshot wait_ns;
+	latency_histogram::snapshot exec_ns;
+};
+
+struct ThreadPoolMetrics
+{
+	ThreadPoolStats stats;
+	std::vector<ThreadPoolWorkerMetrics> workers;
+	std::vector<ThreadPoolGroupMetrics> groups;
+};
+
+class ThreadPool
+{
+	// 有界无锁队列：只有所属线程 push，所有线程（包括所属线程）从头部取任务，保持批内 FIFO 顺序
+	template<class T>
+	class work_stealing_queue
 	{
-		for (size_t i = 0; i < threads; ++i)
-			workers.emplace_back([this] {
+	public:
+		explicit work_stealing_queue(size_t capacity)
+		{
+			size_t size = 1;
+			while (size < capacity)
+				size <<= 1;
+			mask = size - 1;
+			buffer.reset(new std::atomic<T *>[size]);
+		}
+
+		size_t capacity() const { return mask + 1; }
+
+		size_t size() const
+		{
+			int64_t b = bottom.load(std::memory_order_acquire);
+			int64_t t = top.load(std::memory_order_acquire);
+			return b > t ? static_cast<size_t>(b - t) : 0;
+		}
+
+		bool empty() const { return size() == 0; }
+
+		bool push(T *item)
+		{
+			int64_t b = bottom.load(std::memory_order_relaxed);
+			int64_t t = top.load(std::memory_order_acquire);
+			if (b - t > static_cast<int64_t>(mask))
+				return false;
+
+			buffer[b & mask].store(item, std::memory_order_relaxed);
+			bottom.store(b + 1, std::memory_order_release);
+			return true;
+		}
+
+		T *steal()
+		{
 			for (;;)
 			{
-				std::function<void()> task;
+				int64_t t = top.load(std::memory_order_acquire);
+				int64_t b = bottom.load(std::memory_order_acquire);
+				if (t >= b)
+					return nullptr;
 
-				{
-					std::unique_lock<std::mutex> lock_group(task_group_mutex);
+				T *item = buffer[t & mask].load(std::memory_order_relaxed);
+				if (top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+					return item;
+			}
+		}
+
+	private:
+		// top 与 bottom 分别被窃取线程和所属线程频繁修改，隔开避免伪共享
+		std::atomic<int64_t> top{ 0 };
+		char top_padding[cache_line_size - sizeof(std::atomic<int64_t>)];
+		std::atomic<int64_t> bottom{ 0 };
+		char bottom_padding[cache_line_size - sizeof(std::atomic<int64_t>)];
+		size_t mask = 0;
+		std::unique_ptr<std::atomic<T *>[]> buffer;
+	};
+
+	// 分组的直方图，分组被删除后可能还有任务在执行，因此由任务节点共同持有
+	struct group_metrics
+	{
+		// 只在持有 task_group_mutex 时写入
+		latency_histogram wait;
+		latency_histogram exec;
+	};
+
+	struct worker_metrics
+	{
+		// 只由所属线程写入
+		std::atomic<uint64_t> executed{ 0 };
+		std::atomic<uint64_t> busy_ns{ 0 };
+		latency_histogram exec;
+
+		int64_t start_time = 0;
+	};
+
+	// 任务节点，可调用对象直接存放在节点内部，节点由 task_slab 分配和回收
+	struct task_node
+	{
+		task_node *next = nullptr;
+		int64_t enqueue_time = 0;
+
+		// 取出任务时决定是否采样，采样的任务记录所属分组的直方图
+		std::shared_ptr<group_metrics> metrics;
+
+		// 取出任务时记录所属的串行分组，执行完毕后据此放行该分组的下一个任务，0 表示非串行任务
+		uint32_t group_id = 0;
+		uint64_t serial_group = 0;
+		small_function<void(), 6 * sizeof(void *)> task;
+	};
+
+	// 侵入式任务链表
+	struct task_list
+	{
+		task_node *head = nullptr;
+		task_node *tail = nullptr;
+		size_t size = 0;
+
+		bool empty() const { return head == nullptr; }
 
-					wokers_condition.wait(lock_group, [&] {
-						if (stop && !wait_done)
-							return true;
+		void push_back(task_node *node)
+		{
+			node->next = nullptr;
+			if (tail)
+				tail->next = node;
+			else
+				head = node;
+			tail = node;
+			++size;
+		}
+
+		void push_front(task_node *node)
+		{
+			node->next = head;
+			head = node;
+			if (!tail)
+				tail = node;
+			++size;
+		}
+
+		void append(task_list &other)
+		{
+			if (other.empty())
+				return;
+
+			if (tail)
+				tail->next = other.head;
+			else
+				head = other.head;
+			tail = other.tail;
+			size += other.size;
+			other = task_list();
+		}
+
+		task_node *pop_front()
+		{
+			task_node *node = head;
+			head = node->next;
+			if (!head)
+				tail = nullptr;
+			node->next = nullptr;
+			--size;
+			return node;
+		}
+	};
+
+	// 按块分配任务节点，释放的节点放回空闲链表复用，稳定状态下提交任务不再分配内存
+	class task_slab
+	{
+	public:
+		task_node *allocate()
+		{
+			std::lock_guard<spin_lock> lock(free_lock);
+			if (!free_nodes)
+				grow();
+
+			task_node *node = free_nodes;
+			free_nodes = node->next;
+			node->next = nullptr;
+			return node;
+		}
 
-						for (size_t loop = 0; loop < task_group.size(); ++loop)
+		// 一次取出 count 个节点
+		task_list allocate(size_t count)
+		{
+			task_list nodes;
+			std::lock_guard<spin_lock> lock(free_lock);
+			while (nodes.size < count)
+			{
+				if (!free_nodes)
+				{
+					try
+					{
+						grow();
+					}
+					catch (...)
+					{
+						// 已经取出的节点放回空闲链表
+						if (nodes.tail)
 						{
-							if (current_group_iter == task_group.end())
-								current_group_iter = task_group.begin();
-
-							if (!current_group_iter->second.empty())
-							{
-								task = std::move(current_group_iter->second.front());
-								current_group_iter->second.pop_front();
-								++current_group_iter;
-								return true;
-							}
-							else
-							{
-								++current_group_iter;
-							}
+							nodes.tail->next = free_nodes;
+							free_nodes = nodes.head;
 						}
-
-						return stop;
-					});
+						throw;
+					}
 				}
 
-				if (task) task();
-				else break;	// 退出条件一定是 (stop && !wait_done) || (stop && task_group.empty())
+				task_node *node = free_nodes;
+				free_nodes = node->next;
+				nodes.push_back(node);
+			}
+			return nodes;
+		}
+
+		// 释放以 next 串起来的一组节点
+		void release(task_node *first)
+		{
+			if (!first)
+				return;
+
+			task_node *last = first;
+			for (;;)
+			{
+				last->task = nullptr;
+				last->metrics.reset();
+				if (!last->next)
+					break;
+				last = last->next;
+			}
+
+			std::lock_guard<spin_lock> lock(free_lock);
+			last->next = free_nodes;
+			free_nodes = first;
+		}
+
+	private:
+		void grow()
+		{
+			constexpr size_t chunk_size = 256;
+			chunks.emplace_back(new task_node[chunk_size]);
+			task_node *chunk = chunks.back().get();
+			for (size_t i = 0; i < chunk_size; ++i)
+			{
+				chunk[i].next = free_nodes;
+				free_nodes = &chunk[i];
 			}
-		});
+		}
+
+	private:
+		spin_lock free_lock;
+		task_node *free_nodes = nullptr;
+		std::vector<std::unique_ptr<task_node[]>> chunks;
+	};
+
+	struct worker_domain;
+
+	struct task_group_t
+	{
+		uint32_t group_id = 0;
+
+		// 分组的唯一标识，分组被删除后重新添加时会变化
+		uint64_t uid = 0;
+
+		task_list tasks;
+
+		// 串行分组有任务正在执行，此时分组不在就绪环中
+		bool running = false;
+
+		ThreadPoolGroupOptions options;
+		worker_domain *domain = nullptr;
+		int64_t deficit = 0;
+		ThreadPoolGroupStats stats;
+		std::shared_ptr<group_metrics> metrics;
+		uint32_t unsampled = 0;
+
+		// 就绪环链接，只有队列非空的分组在环中
+		task_group_t *ready_prev = nullptr;
+		task_group_t *ready_next = nullptr;
+	};
+
+	struct ready_ring
+	{
+		// 环中下一个被调度的分组
+		task_group_t *cursor = nullptr;
+	};
+
+	// 同一 NUMA 节点上的线程，未开启 numa_aware 时只有一个
+	struct worker_domain
+	{
+		int numa_node = 0;
+		std::condition_variable condition;
+		size_t idle_workers = 0;
+		std::vector<size_t> workers;
+
+		// 绑定到该节点的分组，每个优先级一个就绪环
+		ready_ring rings[3];
+	};
+
+	struct worker_context
+	{
+		worker_context(size_t index, size_t capacity, worker_domain &domain) : index(index), local(capacity), domain(domain) {}
+
+		size_t index = 0;
+		work_stealing_queue<task_node> local;
+		worker_domain &domain;
+		std::vector<int> cpus;
+		worker_metrics metrics;
+
+		// 弹性线程数下开始执行的任务数，只由所属线程写入，监控线程据此判断线程是否都被占住
+		std::atomic<uint64_t> started{ 0 };
+
+		// 线程正在运行或即将启动，需持有 task_group_mutex
+		bool active = false;
+	};
+
+public:
+	ThreadPool(size_t threads, bool wait_on_quit = false)
+		: ThreadPool(make_options(threads, wait_on_quit))
+	{
+	}
+
+	explicit ThreadPool(const ThreadPoolOptions &options)
+		: wait_done(options.wait_on_quit)
+		, work_stealing(options.work_stealing)
+		, steal_batch(std::max<size_t>(options.steal_batch, 1))
+		, numa_aware(options.numa_aware)
+		, capacity(options.capacity)
+		, overflow_policy(options.overflow_policy)
+		, metrics_enabled(options.metrics)
+		, metrics_sample(std::max<uint32_t>(options.metrics_sample, 1))
+		, on_task_begin(options.on_task_begin)
+		, on_task_end(options.on_task_end)
+		, min_threads(options.threads)
+		, elastic(options.max_threads > options.threads)
+		, scale_up_wait_ns(static_cast<int64_t>(options.scale_up_wait_us * 1000))
+		, idle_timeout(options.idle_timeout_ms)
+	{
+		// 弹性线程数下按最大线程数准备好所有线程的上下文，空闲的位置没有线程
+		init_workers(options, std::max(options.threads, options.max_threads));
+		for (size_t i = 0; i < min_threads; ++i)
+			contexts[i]->active = true;
+		active_workers = min_threads;
+
+		std::lock_guard<std::mutex> lock(worker_mutex);
+		workers.resize(contexts.size());
+		for (size_t i = 0; i < min_threads; ++i)
+			workers[i] = make_worker(i);
+		if (elastic)
+			monitor = std::thread(&ThreadPool::monitor_thread, this);
 	}
 
 	~ThreadPool()
@@ -68,79 +545,1256 @@ public:
 			std::lock_guard<std::mutex> lock(task_group_mutex);
 			stop = true;
 		}
-		wokers_condition.notify_all();
-		for (auto &woker : workers)
-			woker.join();
+		notify_all_domains();
+		space_condition.notify_all();
+		monitor_condition.notify_all();
+
+		// 监控线程可能正在启动线程，先等它退出
+		if (monitor.joinable())
+			monitor.join();
+
+		// 此后不再启动新线程，已退出的弹性线程也在这里回收
+		std::vector<std::thread> threads;
+		{
+			std::lock_guard<std::mutex> lock(worker_mutex);
+			joining = true;
+			threads.swap(workers);
+		}
+		for (auto &woker : threads)
+			if (woker.joinable())
+				woker.join();
+
+		// 不等待任务执行完毕时，分组和本地队列中可能还有未执行的任务
+		for (auto &group : task_group)
+			task_nodes.release(group.second.tasks.head);
+		for (auto &context : contexts)
+			while (task_node *task = context->local.steal())
+				task_nodes.release(task);
 	}
 
 	void add_group(uint32_t group_id)
 	{
 		std::lock_guard<std::mutex> lock_group(task_group_mutex);
-		task_group[group_id];
+		find_or_create_group(group_id);
 	}
 
-	void remove_group(uint32_t group_id)
+	void add_group(uint32_t group_id, uint32_t weight, ThreadPoolPriority priority = ThreadPoolPriority::normal)
+	{
+		ThreadPoolGroupOptions options;
+		options.weight = weight;
+		options.priority = priority;
+		add_group(group_id, options);
+	}
+
+	// 分组已存在时更新其调度参数
+	void add_group(uint32_t group_id, const ThreadPoolGroupOptions &options)
 	{
 		std::lock_guard<std::mutex> lock_group(task_group_mutex);
-		if (group_id == current_group_iter->first)
-			current_group_iter = task_group.erase(current_group_iter);
-		else
-			task_group.erase(group_id);
+		task_group_t &group = find_or_create_group(group_id);
+		bool ready = group.ready_next != nullptr;
+		unlink_ready(&group);
+		group.options = options;
+		group.options.weight = std::max<uint32_t>(options.weight, 1);
+		group.domain = find_domain(options.numa_node);
+		group.deficit = std::min<int64_t>(group.deficit, group.options.weight);
+		if (ready)
+			link_ready(&group);
+	}
+
+	ThreadPoolGroupStats group_stats(uint32_t group_id)
+	{
+		std::lock_guard<std::mutex> lock_group(task_group_mutex);
+		auto iter = task_group.find(group_id);
+		if (iter == task_group.end())
+			throw std::runtime_error("not found group id on ThreadPool");
+
+		ThreadPoolGroupStats stats = iter->second.stats;
+		stats.queue_depth = iter->second.tasks.size;
+		return stats;
+	}
+
+	ThreadPoolStats stats()
+	{
+		std::lock_guard<std::mutex> lock_group(task_group_mutex);
+		ThreadPoolStats res = pool_stats;
+		res.pending_tasks = pending_tasks;
+		res.blocked_producers = blocked_producers;
+		res.active_workers = active_workers;
+		return res;
+	}
+
+	// 当前运行中的线程数，弹性线程数下会随负载变化
+	size_t thread_count()
+	{
+		std::lock_guard<std::mutex> lock_group(task_group_mutex);
+		return active_workers;
+	}
+
+	// 所有线程和分组的指标快照，可以通过 thread_pool_json.hpp 转换为 json
+	ThreadPoolMetrics metrics()
+	{
+		ThreadPoolMetrics res;
+		std::vector<std::pair<uint32_t, std::shared_ptr<group_metrics>>> histograms;
+		std::vector<bool> active;
+		{
+			std::lock_guard<std::mutex> lock_group(task_group_mutex);
+			res.stats = pool_stats;
+			res.stats.pending_tasks = pending_tasks;
+			res.stats.blocked_producers = blocked_producers;
+			res.stats.active_workers = active_workers;
+			for (auto &context : contexts)
+				active.push_back(context->active);
+
+			res.groups.reserve(task_group.size());
+			for (auto &item : task_group)
+			{
+				ThreadPoolGroupMetrics group;
+				group.group_id = item.first;
+				group.stats = item.second.stats;
+				group.stats.queue_depth = item.second.tasks.size;
+				res.groups.push_back(group);
+				histograms.emplace_back(item.first, item.second.metrics);
+			}
+		}
+
+		// 直方图是无锁的，在锁外复制
+		for (size_t i = 0; i < res.groups.size(); ++i)
+		{
+			if (histograms[i].second)
+			{
+				res.groups[i].wait_ns = histograms[i].second->wait.get_snapshot();
+				res.groups[i].exec_ns = histograms[i].second->exec.get_snapshot();
+			}
+		}
+		std::sort(res.groups.begin(), res.groups.end(), [](const ThreadPoolGroupMetrics &a, const ThreadPoolGroupMetrics &b) { return a.group_id < b.group_id; });
+
+		int64_t now = now_ns();
+		res.workers.reserve(contexts.size());
+		for (auto &context : contexts)
+		{
+			ThreadPoolWorkerMetrics worker;
+			worker.worker = context->index;
+			worker.numa_node = context->domain.numa_node;
+			worker.active = active[context->index];
+			worker.executed = context->metrics.executed.load(std::memory_order_relaxed);
+			worker.busy_ns = context->metrics.busy_ns.load(std::memory_order_relaxed);
+			if (metrics_enabled)
+			{
+				worker.uptime_ns = static_cast<uint64_t>(std::max<int64_t>(now - context->metrics.start_time, 0));
+				if (worker.uptime_ns)
+					worker.utilization = std::min(static_cast<double>(worker.busy_ns) / static_cast<double>(worker.uptime_ns), 1.0);
+				worker.exec_ns = context->metrics.exec.get_snapshot();
+			}
+			res.workers.push_back(std::move(worker));
+		}
+		return res;
+	}
+
+	void remove_group(uint32_t group_id)
+	{
+		task_node *dropped = nullptr;
+		{
+			std::lock_guard<std::mutex> lock_group(task_group_mutex);
+			auto iter = task_group.find(group_id);
+			if (iter == task_group.end())
+				return;
+
+			pending_tasks -= iter->second.tasks.size;
+			unlink_ready(&iter->second);
+			dropped = iter->second.tasks.head;
+			task_group.erase(iter);
+
+			// 等待该分组空间的提交线程需要醒来并抛出异常
+			if (blocked_producers > 0)
+				space_condition.notify_all();
+		}
+
+		// 被丢弃的任务在锁外析构，broken_promise 触发的回调可能再向线程池提交任务
+		task_nodes.release(dropped);
 	}
 
 	template<class F, class... Args>
 	decltype(auto) push_front_task(uint32_t group_id, F&& f, Args&&... args)
 	{
-		return enqueue(group_id, true, f, std::forward(args)...);
+		return enqueue(group_id, true, std::forward<F>(f), std::forward<Args>(args)...);
 	}
 
 	template<class F, class... Args>
 	decltype(auto) push_back_task(uint32_t group_id, F&& f, Args&&... args)
 	{
-		return enqueue(group_id, false, f, std::forward(args)...);
+		return enqueue(group_id, false, std::forward<F>(f), std::forward<Args>(args)...);
 	}
 
-private:
+	// 不关心返回值的任务，不创建 task_future，稳定状态下不分配内存
+	// 队列已满且策略为 fail_fast 时返回 false
 	template<class F, class... Args>
-	// auto enqueue(uint32_t group_id, bool to_front, F&& f, Args&&... args) -> std::future<typename std::result_of<F(Args...)>::type>
-	decltype(auto) enqueue(uint32_t group_id, bool to_front, F&& f, Args&&... args)
+	bool post(uint32_t group_id, F&& f, Args&&... args)
 	{
-		using return_type = typename std::result_of<F(Args...)>::type;
+		task_node *node = task_nodes.allocate();
+		try
+		{
+			node->task = make_task(std::forward<F>(f), std::forward<Args>(args)...);
+		}
+		catch (...)
+		{
+			task_nodes.release(node);
+			throw;
+		}
 
-		auto task = std::make_shared< std::packaged_task<return_type()> >(
-			std::bind(std::forward<F>(f), std::forward<Args>(args)...)
-			);
+		task_list tasks;
+		tasks.push_back(node);
+		return push_tasks(group_id, false, tasks);
+	}
 
-		std::lock_guard<std::mutex> lock_group(task_group_mutex);
-		auto iter = task_group.find(group_id);
-		if (iter == task_group.end())
-			throw std::runtime_error("not found group id on ThreadPool");
+#if TASK_FUTURE_HAS_COROUTINE
+	// 持有协程句柄的任务，没有执行就被丢弃时（overrun_oldest、remove_group、停止时不等待队列）销毁协程帧，
+	// 协程的 promise 随之析构，等待它的 task_future 得到 broken_promise 而不是一直等待
+	class resume_task
+	{
+	public:
+		explicit resume_task(std::coroutine_handle<> handle) noexcept : handle(handle) {}
+		resume_task(resume_task &&other) noexcept : handle(other.handle) { other.handle = nullptr; }
+		resume_task(const resume_task &) = delete;
+		resume_task& operator=(const resume_task &) = delete;
+		resume_task& operator=(resume_task &&) = delete;
 
-		std::future<return_type> res = task->get_future();
+		~resume_task()
 		{
-			if (stop)
-				throw std::runtime_error("enqueue on stopped ThreadPool");
+			// 提交时就被拒绝的任务在 post 内部析构，由 await_suspend 抛出异常让协程继续执行
+			if (handle && handle.address() != submitting())
+				handle.destroy();
+		}
 
-			if (to_front)
-				iter->second.emplace_front([task]() { (*task)(); });
-			else
-				iter->second.emplace_back([task]() { (*task)(); });
+		void operator()()
+		{
+			std::coroutine_handle<> current = handle;
+			handle = nullptr;
+			current.resume();
 		}
-		wokers_condition.notify_one();
-		return res;
-	}
 
+		// 当前线程正在提交的协程
+		static void *&submitting() noexcept
+		{
+			thread_local void *address = nullptr;
+			return address;
+		}
 
-private:
-	bool stop = false;
+	private:
+		std::coroutine_handle<> handle;
+	};
 
-	// 停止时是否等待队列中的任务执行完毕
-	bool wait_done = false;
+	// co_await pool.schedule_on(group_id) 之后协程在该分组的线程中继续执行，遵循分组的优先级、串行等调度规则
+	// 队列已满且策略为 fail_fast 时在 co_await 处抛出 ThreadPoolQueueFull；任务被丢弃时协程帧被销毁，等待它的 task_future 得到 broken_promise
+	class schedule_awaiter
+	{
+	public:
+		schedule_awaiter(ThreadPool &pool, uint32_t group_id) : pool(pool), group_id(group_id) {}
 
-	std::condition_variable wokers_condition;
-	std::vector< std::thread > workers;
+		bool await_ready() const noexcept { return false; }
 
-	std::mutex task_group_mutex;
-	std::map< uint32_t, std::deque<std::function<void()>> > task_group;
-	std::map< uint32_t, std::deque<std::function<void()>> >::iterator current_group_iter = task_group.begin();
+		void await_suspend(std::coroutine_handle<> handle)
+		{
+			// 提交成功后协程可能已经在其他线程中恢复或被销毁，之后不能再访问本对象
+			void *&submitting = resume_task::submitting();
+			submitting = handle.address();
+			bool posted = false;
+			try
+			{
+				posted = pool.post(group_id, resume_task(handle));
+			}
+			catch (...)
+			{
+				submitting = nullptr;
+				throw;
+			}
+			submitting = nullptr;
+
+			if (!posted)
+				throw ThreadPoolQueueFull();
+		}
+
+		void await_resume() const noexcept {}
+
+	private:
+		ThreadPool &pool;
+		uint32_t group_id;
+	};
+
+	schedule_awaiter schedule_on(uint32_t group_id)
+	{
+		return schedule_awaiter(*this, group_id);
+	}
+#endif
+
+	// 批量提交无参任务，只加锁一次，并且只唤醒批量任务需要的线程数
+	template<class Iter>
+	auto push_back_tasks(uint32_t group_id, Iter first, Iter last)
+	{
+		// 任务保存的是元素的副本，以左值调用
+		using return_type = decltype(std::declval<std::decay_t<typename std::iterator_traits<Iter>::reference> &>()());
+
+		std::vector<task_future<return_type>> res;
+		task_list batch = task_nodes.allocate(static_cast<size_t>(std::distance(first, last)));
+		res.reserve(batch.size);
+		try
+		{
+			for (task_node *node = batch.head; node; node = node->next, ++first)
+			{
+				task_promise<return_type> promise;
+				res.push_back(promise.get_future());
+				node->task = make_promise_task(std::move(promise), *first);
+			}
+		}
+		catch (...)
+		{
+			task_nodes.release(batch.head);
+			throw;
+		}
+
+		// 整批被拒绝时所有 task_future 都得到 ThreadPoolQueueFull
+		if (!push_tasks(group_id, false, batch))
+			for (auto &future : res)
+				future = rejected_future<return_type>();
+		return res;
+	}
+
+	template<class Range>
+	auto push_back_tasks(uint32_t group_id, Range &&tasks)
+	{
+		using std::begin;
+		using std::end;
+		return push_back_tasks(group_id, begin(tasks), end(tasks));
+	}
+
+	// 批量提交不关心返回值的无参任务
+	// 队列已满且策略为 fail_fast 时整批拒绝并返回 false
+	template<class Iter>
+	bool post_bulk(uint32_t group_id, Iter first, Iter last)
+	{
+		task_list batch = task_nodes.allocate(static_cast<size_t>(std::distance(first, last)));
+		try
+		{
+			for (task_node *node = batch.head; node; node = node->next, ++first)
+				node->task = *first;
+		}
+		catch (...)
+		{
+			task_nodes.release(batch.head);
+			throw;
+		}
+
+		return push_tasks(group_id, false, batch);
+	}
+
+	template<class Range>
+	bool post_bulk(uint32_t group_id, Range &&tasks)
+	{
+		using std::begin;
+		using std::end;
+		return post_bulk(group_id, begin(tasks), end(tasks));
+	}
+
+private:
+	template<class F, class... Args>
+	decltype(auto) enqueue(uint32_t group_id, bool to_front, F&& f, Args&&... args)
+	{
+		// std::result_of 在 C++20 中已移除，按 make_task 实际的调用方式推导返回值
+		using return_type = decltype(invoke(std::declval<std::decay_t<F> &>(), std::declval<std::decay_t<Args>>()...));
+
+		task_promise<return_type> promise;
+		task_future<return_type> res = promise.get_future();
+
+		task_node *node = task_nodes.allocate();
+		try
+		{
+			node->task = make_promise_task(std::move(promise), make_task(std::forward<F>(f), std::forward<Args>(args)...));
+		}
+		catch (...)
+		{
+			task_nodes.release(node);
+			throw;
+		}
+
+		task_list tasks;
+		tasks.push_back(node);
+		if (!push_tasks(group_id, to_front, tasks))
+			return rejected_future<return_type>();
+		return res;
+	}
+
+	// 被拒绝的任务已经随 promise 一起销毁，另外返回一个带有 ThreadPoolQueueFull 的 task_future
+	template<class R>
+	static task_future<R> rejected_future()
+	{
+		task_promise<R> promise;
+		promise.set_exception(std::make_exception_ptr(ThreadPoolQueueFull()));
+		return promise.get_future();
+	}
+
+	// 任务执行结果保存到 promise，任务未执行就被销毁时 task_future 得到 broken_promise
+	template<class R, class F>
+	static auto make_promise_task(task_promise<R> &&promise, F&& f)
+	{
+		return [promise = std::move(promise), f = std::forward<F>(f)]() mutable {
+			promise.set_result_of(f);
+		};
+	}
+
+	// 保存参数的副本，任务只执行一次，调用时将参数移动给 f，因此支持只能移动的参数
+	template<class F>
+	static decltype(auto) make_task(F&& f)
+	{
+		return std::forward<F>(f);
+	}
+
+	template<class F, class Arg, class... Args>
+	static decltype(auto) make_task(F&& f, Arg&& arg, Args&&... args)
+	{
+		return [f = std::forward<F>(f), args = std::make_tuple(std::forward<Arg>(arg), std::forward<Args>(args)...)]() mutable {
+			return invoke_task(f, args, std::make_index_sequence<1 + sizeof...(Args)>());
+		};
+	}
+
+	template<class F, class Tuple, size_t... I>
+	static decltype(auto) invoke_task(F &f, Tuple &args, std::index_sequence<I...>)
+	{
+		return invoke(f, std::move(std::get<I>(args))...);
+	}
+
+	// C++14 没有 std::invoke，成员函数指针通过 std::mem_fn 调用，第一个参数为对象的指针或引用
+	template<class F, class... Args, std::enable_if_t<std::is_member_pointer<std::decay_t<F>>::value, int> = 0>
+	static decltype(auto) invoke(F &&f, Args&&... args)
+	{
+		return std::mem_fn(f)(std::forward<Args>(args)...);
+	}
+
+	template<class F, class... Args, std::enable_if_t<!std::is_member_pointer<std::decay_t<F>>::value, int> = 0>
+	static decltype(auto) invoke(F &&f, Args&&... args)
+	{
+		return std::forward<F>(f)(std::forward<Args>(args)...);
+	}
+
+	// 加锁一次提交一批任务，只唤醒需要的线程数；任务被拒绝时返回 false
+	bool push_tasks(uint32_t group_id, bool to_front, task_list &batch)
+	{
+		if (batch.empty())
+			return true;
+
+		int64_t now = now_ns();
+		for (task_node *node = batch.head; node; node = node->next)
+			node->enqueue_time = now;
+
+		size_t count = batch.size;
+		size_t wake = 0;
+		size_t spawn = no_worker;
+		worker_domain *domain = nullptr;
+		task_list dropped;
+		{
+			std::unique_lock<std::mutex> lock_group(task_group_mutex);
+			task_group_t *group = nullptr;
+			bool overflowed = false;
+			for (;;)
+			{
+				auto iter = task_group.find(group_id);
+				if (iter == task_group.end())
+				{
+					lock_group.unlock();
+					task_nodes.release(batch.head);
+					task_nodes.release(dropped.head);
+					throw std::runtime_error("not found group id on ThreadPool");
+				}
+
+				if (stop)
+				{
+					lock_group.unlock();
+					task_nodes.release(batch.head);
+					task_nodes.release(dropped.head);
+					throw std::runtime_error("enqueue on stopped ThreadPool");
+				}
+
+				group = &iter->second;
+				if (has_space(*group, count))
+					break;
+
+				// 每次提交只计一次，block 策略被唤醒后空间又被抢走时不重复计数
+				if (!overflowed)
+				{
+					overflowed = true;
+					++group->stats.overflows;
+					++pool_stats.overflows;
+				}
+
+				if (!make_space(*group, count, dropped, lock_group))
+				{
+					// fail_fast，或者 overrun_oldest 清空本分组后仍然放不下
+					group->stats.rejected += count;
+					pool_stats.rejected += count;
+					lock_group.unlock();
+					task_nodes.release(batch.head);
+					task_nodes.release(dropped.head);
+					return false;
+				}
+			}
+
+			// 分组中最早的任务已经等待太久
+			spawn = reserve_worker(group->tasks.empty() ? 0 : now - group->tasks.head->enqueue_time, wake_domain(*group));
+
+			pending_tasks += count;
+			pool_stats.max_pending_tasks = std::max(pool_stats.max_pending_tasks, pending_tasks);
+			group->stats.enqueued += count;
+			if (to_front)
+				batch.append(group->tasks);
+			group->tasks.append(batch);
+			group->stats.max_queue_depth = std::max(group->stats.max_queue_depth, group->tasks.size);
+			link_ready(group);
+			domain = &wake_domain(*group);
+			wake = std::min(count, domain->idle_workers);
+		}
+
+		// 被丢弃的任务在锁外析构
+		task_nodes.release(dropped.head);
+
+		while (wake-- > 0)
+			domain->condition.notify_one();
+
+		if (spawn != no_worker)
+			start_worker(spawn);
+		return true;
+	}
+
+	// 一批任务超过容量时，只要队列为空就允许放入；需持有 task_group_mutex
+	bool group_has_space(const task_group_t &group, size_t count) const
+	{
+		return group.options.capacity == 0 || group.tasks.empty() || group.tasks.size + count <= group.options.capacity;
+	}
+
+	bool pool_has_space(size_t count) const
+	{
+		return capacity == 0 || pending_tasks == 0 || pending_tasks + count <= capacity;
+	}
+
+	bool has_space(const task_group_t &group, size_t count) const
+	{
+		return group_has_space(group, count) && pool_has_space(count);
+	}
+
+	// 队列已满时按分组（分组未满时按线程池）的溢出策略处理，返回 false 表示拒绝；需持有 task_group_mutex
+	// block 策略等待后返回 true，调用方需要重新查找分组并检查空间
+	bool make_space(task_group_t &group, size_t count, task_list &dropped, std::unique_lock<std::mutex> &lock_group)
+	{
+		ThreadPoolOverflowPolicy policy = group_has_space(group, count) ? overflow_policy : group.options.overflow_policy;
+
+		switch (policy)
+		{
+		case ThreadPoolOverflowPolicy::block:
+			++blocked_producers;
+			space_condition.wait(lock_group);
+			--blocked_producers;
+			return true;
+		case ThreadPoolOverflowPolicy::fail_fast:
+			return false;
+		case ThreadPoolOverflowPolicy::overrun_oldest:
+			break;
+		}
+
+		// 线程池满时同样只丢弃本分组的任务，不影响其他分组
+		while (!group.tasks.empty() && !has_space(group, count))
+		{
+			dropped.push_back(group.tasks.pop_front());
+			--pending_tasks;
+			++group.stats.dropped;
+			++pool_stats.dropped;
+		}
+
+		if (group.tasks.empty())
+		{
+			group.deficit = 0;
+			unlink_ready(&group);
+		}
+		return has_space(group, count);
+	}
+
+	std::thread make_worker(size_t index)
+	{
+		if (work_stealing)
+			return std::thread(&ThreadPool::work_stealing_thread, this, index);
+		return std::thread(&ThreadPool::worker_thread, this, index);
+	}
+
+	// 任务等待时间超过阈值（或者没有线程在运行）且节点上没有空闲线程时，预留一个未运行的线程位置，返回 no_worker 表示不需要增加线程
+	// 同一时刻只增加一个线程，新线程开始运行后才会再次增加；需持有 task_group_mutex
+	size_t reserve_worker(int64_t wait_ns, const worker_domain &domain)
+	{
+		if (!elastic || stop || spawning || domain.idle_workers > 0)
+			return no_worker;
+		if (wait_ns < scale_up_wait_ns && active_workers > 0)
+			return no_worker;
+
+		// 优先选择同一节点上的位置
+		size_t index = no_worker;
+		for (size_t i : domain.workers)
+		{
+			if (!contexts[i]->active)
+			{
+				index = i;
+				break;
+			}
+		}
+		for (size_t i = 0; i < contexts.size() && index == no_worker; ++i)
+			if (!contexts[i]->active)
+				index = i;
+		if (index == no_worker)
+			return no_worker;
+
+		contexts[index]->active = true;
+		++active_workers;
+		spawning = true;
+		return index;
+	}
+
+	// 在 reserve_worker 预留的位置启动线程，不能持有 task_group_mutex
+	void start_worker(size_t index)
+	{
+		std::lock_guard<std::mutex> lock(worker_mutex);
+		if (joining)
+			return;
+
+		// 该位置上次运行的线程已经退出
+		if (workers[index].joinable())
+			workers[index].join();
+
+		try
+		{
+			workers[index] = make_worker(index);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock_group(task_group_mutex);
+			contexts[index]->active = false;
+			--active_workers;
+			spawning = false;
+		}
+	}
+
+	// 空闲超时后线程数多于最小值时退出；需持有 task_group_mutex
+	bool retire_worker(worker_context &self)
+	{
+		if (!elastic || stop || active_workers <= min_threads)
+			return false;
+
+		self.active = false;
+		--active_workers;
+		return true;
+	}
+
+	// 需要窃取说明任务在本地队列中积压，等待时间过长时增加线程
+	void scale_up_on_steal(worker_context &self, const task_node *task)
+	{
+		int64_t wait_ns = now_ns() - task->enqueue_time;
+		if (wait_ns < scale_up_wait_ns)
+			return;
+
+		size_t spawn = no_worker;
+		{
+			std::lock_guard<std::mutex> lock_group(task_group_mutex);
+			spawn = reserve_worker(wait_ns, self.domain);
+		}
+		if (spawn != no_worker)
+			start_worker(spawn);
+	}
+
+	// 任务的等待时间只在提交和取出任务时检查，所有线程都在执行长任务时没有这样的时机，由监控线程定时检查
+	// 某个节点上次检查时就有可运行的任务，这段时间内该节点的线程一个任务都没有开始执行，说明这些任务至少已经等待了 scale_up_wait
+	// 本地队列中的任务随时可能被取走，不能读取其入队时间，因此按进度判断
+	void monitor_thread()
+	{
+		auto period = std::chrono::microseconds(std::max<int64_t>(scale_up_wait_ns / 1000, 1000));
+		std::vector<uint64_t> progress(domains.size(), 0);
+		std::vector<bool> queued(domains.size(), false);
+
+		std::unique_lock<std::mutex> lock_group(task_group_mutex);
+		while (!monitor_condition.wait_for(lock_group, period, [this] { return stop; }))
+		{
+			for (size_t i = 0; i < domains.size() && !stop; ++i)
+			{
+				worker_domain &domain = *domains[i];
+				uint64_t started = 0;
+				for (size_t index : domain.workers)
+					started += contexts[index]->started.load(std::memory_order_relaxed);
+
+				bool stalled = queued[i] && progress[i] == started;
+				queued[i] = has_runnable_tasks(domain);
+				progress[i] = started;
+				if (!stalled || !queued[i])
+					continue;
+
+				size_t spawn = reserve_worker(scale_up_wait_ns, domain);
+				if (spawn == no_worker)
+					continue;
+
+				lock_group.unlock();
+				start_worker(spawn);
+				lock_group.lock();
+			}
+		}
+	}
+
+	// 节点的线程可以执行的任务：就绪环中的分组（执行中的串行分组不在环中）和本地队列；需持有 task_group_mutex
+	bool has_runnable_tasks(const worker_domain &domain) const
+	{
+		for (size_t priority = 0; priority < 3; ++priority)
+			if (domain.rings[priority].cursor || ready_rings[priority].cursor)
+				return true;
+		return work_stealing && has_local_tasks(domain);
+	}
+
+	// 新增的线程开始运行，允许再次增加线程
+	void worker_started()
+	{
+		if (!elastic)
+			return;
+
+		std::lock_guard<std::mutex> lock_group(task_group_mutex);
+		spawning = false;
+	}
+
+	static int64_t now_ns()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void run_task(worker_context &self, task_node *task)
+	{
+		if (elastic)
+			self.started.store(self.started.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+		worker_metrics &metrics = self.metrics;
+		bool sampled = task->metrics != nullptr;
+		if (metrics_enabled)
+			metrics.executed.store(metrics.executed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+		if (!sampled && !on_task_begin && !on_task_end)
+		{
+			task->task();
+			task_nodes.release(task);
+			return;
+		}
+
+		ThreadPoolTaskInfo info;
+		info.group_id = task->group_id;
+		info.worker = self.index;
+
+		int64_t begin = now_ns();
+		info.wait_ns = static_cast<uint64_t>(std::max<int64_t>(begin - task->enqueue_time, 0));
+		if (on_task_begin)
+			on_task_begin(info);
+
+		task->task();
+
+		info.exec_ns = static_cast<uint64_t>(std::max<int64_t>(now_ns() - begin, 0));
+		if (sampled)
+		{
+			metrics.busy_ns.store(metrics.busy_ns.load(std::memory_order_relaxed) + info.exec_ns * metrics_sample, std::memory_order_relaxed);
+			metrics.exec.record_single_writer(info.exec_ns);
+			task->metrics->exec.record(info.exec_ns);
+		}
+
+		if (on_task_end)
+			on_task_end(info);
+		task_nodes.release(task);
+	}
+
+	task_group_t &find_or_create_group(uint32_t group_id)
+	{
+		auto res = task_group.emplace(group_id, task_group_t());
+		if (res.second)
+		{
+			res.first->second.group_id = group_id;
+			res.first->second.uid = ++group_uid;
+			if (metrics_enabled)
+				res.first->second.metrics = std::make_shared<group_metrics>();
+		}
+		return res.first->second;
+	}
+
+	ready_ring &ring_of(const task_group_t *group)
+	{
+		size_t priority = static_cast<size_t>(group->options.priority);
+		return group->domain ? group->domain->rings[priority] : ready_rings[priority];
+	}
+
+	// 新就绪的分组插入到游标之前，即排在本轮最后；to_front 为 true 时成为下一个被调度的分组
+	void link_ready(task_group_t *group, bool to_front = false)
+	{
+		if (group->ready_next || group->running)
+			return;
+
+		ready_ring &ring = ring_of(group);
+		if (!ring.cursor)
+		{
+			group->ready_prev = group->ready_next = group;
+			ring.cursor = group;
+			return;
+		}
+
+		group->ready_next = ring.cursor;
+		group->ready_prev = ring.cursor->ready_prev;
+		ring.cursor->ready_prev->ready_next = group;
+		ring.cursor->ready_prev = group;
+		if (to_front)
+			ring.cursor = group;
+	}
+
+	void unlink_ready(task_group_t *group)
+	{
+		if (!group->ready_next)
+			return;
+
+		ready_ring &ring = ring_of(group);
+		if (group->ready_next == group)
+		{
+			ring.cursor = nullptr;
+		}
+		else
+		{
+			group->ready_prev->ready_next = group->ready_next;
+			group->ready_next->ready_prev = group->ready_prev;
+			if (ring.cursor == group)
+				ring.cursor = group->ready_next;
+		}
+		group->ready_prev = group->ready_next = nullptr;
+	}
+
+	// 优先级从高到低找到第一个非空的就绪环，同一优先级先取绑定到本节点的分组，需持有 task_group_mutex
+	task_node *pop_next_task(int64_t now, worker_domain &domain)
+	{
+		for (size_t priority = 0; priority < 3; ++priority)
+		{
+			if (task_node *task = pop_from_ring(domain.rings[priority], now))
+				return task;
+			if (task_node *task = pop_from_ring(ready_rings[priority], now))
+				return task;
+		}
+
+		return nullptr;
+	}
+
+	// 环内按 deficit round robin 取出一个任务，O(1)
+	task_node *pop_from_ring(ready_ring &ring, int64_t now)
+	{
+		task_group_t *group = ring.cursor;
+		if (!group)
+			return nullptr;
+
+		// 轮到该分组时补充额度，每个任务消耗 1
+		if (group->deficit <= 0)
+			group->deficit += group->options.weight;
+
+		task_node *task = group->tasks.pop_front();
+		--group->deficit;
+		--pending_tasks;
+
+		if (blocked_producers > 0)
+			space_condition.notify_all();
+
+		uint64_t wait_ns = static_cast<uint64_t>(std::max<int64_t>(now - task->enqueue_time, 0));
+		++group->stats.dequeued;
+		group->stats.total_wait_us += wait_ns / 1000;
+		group->stats.max_wait_us = std::max(group->stats.max_wait_us, wait_ns / 1000);
+		// 等待时间直方图与执行时间一样只记录采样的任务
+		if (group->metrics && ++group->unsampled >= metrics_sample)
+		{
+			group->unsampled = 0;
+			group->metrics->wait.record_single_writer(wait_ns);
+			task->metrics = group->metrics;
+		}
+
+		task->group_id = group->group_id;
+		task->serial_group = group->options.serial ? group->uid : 0;
+
+		if (group->tasks.empty())
+			group->deficit = 0;
+
+		if (group->options.serial)
+		{
+			// 串行分组在任务执行完毕前移出就绪环
+			group->running = true;
+			unlink_ready(group);
+		}
+		else if (group->tasks.empty())
+		{
+			unlink_ready(group);
+		}
+		else if (group->deficit <= 0)
+		{
+			ring.cursor = group->ready_next;
+		}
+		return task;
+	}
+
+	// 串行分组的任务执行完毕，分组重新进入就绪环，本轮额度未用完时排在最前面；需持有 task_group_mutex
+	// 有新的任务可以执行时返回需要唤醒的节点
+	worker_domain *finish_serial(uint32_t group_id, uint64_t serial_group)
+	{
+		auto iter = task_group.find(group_id);
+		if (iter == task_group.end() || iter->second.uid != serial_group)
+			return nullptr;
+
+		task_group_t &group = iter->second;
+		group.running = false;
+		if (group.tasks.empty())
+			return nullptr;
+
+		link_ready(&group, group.deficit > 0);
+		return &wake_domain(group);
+	}
+
+	static ThreadPoolOptions make_options(size_t threads, bool wait_on_quit)
+	{
+		ThreadPoolOptions options;
+		options.threads = threads;
+		options.wait_on_quit = wait_on_quit;
+		return options;
+	}
+
+	void init_workers(const ThreadPoolOptions &options, size_t threads)
+	{
+		std::vector<int> cpus = options.cpus;
+		if (options.numa_aware && cpus.empty())
+			cpus = online_cpus();
+
+		// 每个线程的 CPU 集合及其 NUMA 节点
+		std::vector<std::vector<int>> worker_cpus(threads);
+		std::vector<int> worker_nodes(threads, 0);
+		if (options.pin_workers && !cpus.empty())
+		{
+			for (size_t i = 0; i < threads; ++i)
+			{
+				int cpu = cpus[i % cpus.size()];
+				worker_cpus[i].push_back(cpu);
+				if (options.numa_aware)
+					worker_nodes[i] = numa_node_of_cpu(cpu);
+			}
+		}
+		else if (options.numa_aware && !cpus.empty())
+		{
+			std::vector<std::pair<int, std::vector<int>>> nodes;
+			for (int cpu : cpus)
+			{
+				int node = numa_node_of_cpu(cpu);
+				auto iter = std::find_if(nodes.begin(), nodes.end(), [node](const std::pair<int, std::vector<int>> &item) { return item.first == node; });
+				if (iter == nodes.end())
+					iter = nodes.emplace(nodes.end(), node, std::vector<int>());
+				iter->second.push_back(cpu);
+			}
+
+			for (size_t i = 0; i < threads; ++i)
+			{
+				worker_nodes[i] = nodes[i % nodes.size()].first;
+				worker_cpus[i] = nodes[i % nodes.size()].second;
+			}
+		}
+		else
+		{
+			for (size_t i = 0; i < threads; ++i)
+				worker_cpus[i] = cpus;
+		}
+
+		size_t capacity = work_stealing ? steal_batch : 1;
+		for (size_t i = 0; i < threads; ++i)
+		{
+			worker_domain *domain = numa_aware ? find_domain(worker_nodes[i]) : nullptr;
+			if (!numa_aware && !domains.empty())
+				domain = domains.front().get();
+
+			if (!domain)
+			{
+				domains.emplace_back(new worker_domain());
+				domain = domains.back().get();
+				domain->numa_node = worker_nodes[i];
+			}
+
+			domain->workers.push_back(i);
+			contexts.emplace_back(new worker_context(i, capacity, *domain));
+			contexts.back()->cpus = std::move(worker_cpus[i]);
+			contexts.back()->metrics.start_time = now_ns();
+		}
+
+		if (domains.empty())
+			domains.emplace_back(new worker_domain());
+	}
+
+	// 节点上有线程时返回该节点，否则返回 nullptr
+	worker_domain *find_domain(int numa_node)
+	{
+		if (!numa_aware || numa_node < 0)
+			return nullptr;
+
+		for (auto &domain : domains)
+			if (domain->numa_node == numa_node)
+				return domain.get();
+		return nullptr;
+	}
+
+	// 分组有新任务时需要唤醒的节点，未绑定的分组唤醒空闲线程最多的节点；需持有 task_group_mutex
+	worker_domain &wake_domain(const task_group_t &group)
+	{
+		if (group.domain)
+			return *group.domain;
+
+		worker_domain *target = domains.front().get();
+		for (auto &domain : domains)
+			if (domain->idle_workers > target->idle_workers)
+				target = domain.get();
+		return *target;
+	}
+
+	void notify_all_domains()
+	{
+		for (auto &domain : domains)
+			domain->condition.notify_all();
+	}
+
+	void worker_thread(size_t index)
+	{
+		worker_context &self = *contexts[index];
+		set_current_thread_affinity(self.cpus);
+		worker_started();
+
+		// 上一个执行完的串行任务，在下次加锁取任务时一并放行其分组
+		uint32_t done_group = 0;
+		uint64_t done_serial = 0;
+
+		for (;;)
+		{
+			task_node *task = nullptr;
+			bool drained = false;
+			bool retired = false;
+			size_t spawn = no_worker;
+
+			{
+				std::unique_lock<std::mutex> lock_group(task_group_mutex);
+
+				if (done_serial)
+					finish_serial(done_group, done_serial);
+
+				int64_t now = 0;
+				auto ready = [&] {
+					if (stop && !wait_done)
+						return true;
+
+					now = now_ns();
+					if ((task = pop_next_task(now, self.domain)) != nullptr)
+						return true;
+
+					// 串行分组的任务还在执行时，队列里的任务要等它执行完毕
+					return stop && pending_tasks == 0;
+				};
+
+				++self.domain.idle_workers;
+				if (!elastic)
+					self.domain.condition.wait(lock_group, ready);
+				else
+					while (!self.domain.condition.wait_for(lock_group, idle_timeout, ready) && !(retired = retire_worker(self)))
+						;
+				--self.domain.idle_workers;
+				drained = stop && pending_tasks == 0;
+
+				if (task)
+					spawn = reserve_worker(now - task->enqueue_time, self.domain);
+			}
+
+			// 取走了最后一个任务，唤醒其他等待退出的线程
+			if (drained)
+				notify_all_domains();
+
+			if (spawn != no_worker)
+				start_worker(spawn);
+
+			if (!task)
+				break;	// 退出条件一定是 (stop && !wait_done) || (stop && pending_tasks == 0) || retired
+
+			done_group = task->group_id;
+			done_serial = task->serial_group;
+			run_task(self, task);
+		}
+	}
+
+	void work_stealing_thread(size_t index)
+	{
+		worker_context &self = *contexts[index];
+		set_current_thread_affinity(self.cpus);
+		worker_started();
+
+		for (;;)
+		{
+			task_node *task = self.local.steal();
+			if (!task && (task = steal_task(index)) != nullptr && elastic)
+				scale_up_on_steal(self, task);
+
+			if (!task && !refill_local(self, task))
+				break;
+
+			if (!task)
+				continue;
+
+			uint32_t group_id = task->group_id;
+			uint64_t serial_group = task->serial_group;
+			run_task(self, task);
+
+			if (serial_group)
+			{
+				worker_domain *domain = nullptr;
+				{
+					std::lock_guard<std::mutex> lock_group(task_group_mutex);
+					domain = finish_serial(group_id, serial_group);
+					if (domain && domain->idle_workers == 0)
+						domain = nullptr;
+				}
+				if (domain)
+					domain->condition.notify_one();
+			}
+		}
+	}
+
+	// 只从同一节点的线程窃取，绑定到节点的任务不会被其他节点执行
+	task_node *steal_task(size_t index)
+	{
+		const std::vector<size_t> &peers = contexts[index]->domain.workers;
+		size_t position = static_cast<size_t>(std::find(peers.begin(), peers.end(), index) - peers.begin());
+		for (size_t i = 1; i < peers.size(); ++i)
+		{
+			if (task_node *task = contexts[peers[(position + i) % peers.size()]]->local.steal())
+				return task;
+		}
+		return nullptr;
+	}
+
+	// 本地队列只在持有 task_group_mutex 时 push，因此锁内检查到所有本地队列为空后，不会再有新的可窃取任务
+	bool has_local_tasks(const worker_domain &domain) const
+	{
+		for (size_t index : domain.workers)
+			if (!contexts[index]->local.empty())
+				return true;
+		return false;
+	}
+
+	// 从分组中按轮询顺序批量取任务放入本地队列，返回 false 表示线程退出
+	bool refill_local(worker_context &self, task_node *&task)
+	{
+		worker_domain &domain = self.domain;
+		std::unique_lock<std::mutex> lock_group(task_group_mutex);
+		int64_t now = 0;
+		bool timeout = false;
+		for (;;)
+		{
+			if (stop && !wait_done)
+				return false;
+
+			now = now_ns();
+			if ((task = pop_next_task(now, domain)) != nullptr)
+				break;
+
+			// 同一节点其他线程的本地队列还有任务，回去窃取
+			if (has_local_tasks(domain))
+				return true;
+
+			// 串行分组的任务还在执行时，队列里的任务要等它执行完毕
+			if (stop && pending_tasks == 0)
+				return false;
+
+			// 本地队列一定为空，可以直接退出
+			if (timeout && retire_worker(self))
+				return false;
+
+			++domain.idle_workers;
+			if (elastic)
+				timeout = domain.condition.wait_for(lock_group, idle_timeout) == std::cv_status::timeout;
+			else
+				domain.condition.wait(lock_group);
+			--domain.idle_workers;
+		}
+
+		size_t spawn = reserve_worker(now - task->enqueue_time, domain);
+
+		// 每次最多取平均份额，避免一个线程把任务全部取走；弹性线程数下按最大线程数计算，给新增的线程留出任务
+		size_t share = (pending_tasks + contexts.size()) / contexts.size();
+		size_t count = std::min(share, std::min(steal_batch, self.local.capacity()));
+
+		size_t pushed = 0;
+		while (pushed + 1 < count)
+		{
+			task_node *next = pop_next_task(now, domain);
+			if (!next)
+				break;
+			self.local.push(next);
+			++pushed;
+		}
+
+		size_t wake = std::min(pushed, domain.idle_workers);
+		bool drained = stop && pending_tasks == 0;
+		lock_group.unlock();
+
+		// 取走了最后一个任务，唤醒其他等待退出的线程
+		if (drained)
+			notify_all_domains();
+		else
+			while (wake-- > 0)
+				domain.condition.notify_one();
+
+		if (spawn != no_worker)
+			start_worker(spawn);
+		return true;
+	}
+
+private:
+	bool stop = false;
+
+	// 停止时是否等待队列中的任务执行完毕
+	bool wait_done = false;
+
+	const bool work_stealing = false;
+	const size_t steal_batch = 1;
+	const bool numa_aware = false;
+
+	// 所有分组排队任务数的上限
+	const size_t capacity = 0;
+	const ThreadPoolOverflowPolicy overflow_policy = ThreadPoolOverflowPolicy::block;
+
+	const bool metrics_enabled = false;
+	const uint32_t metrics_sample = 1;
+	const std::function<void(const ThreadPoolTaskInfo &)> on_task_begin;
+	const std::function<void(const ThreadPoolTaskInfo &)> on_task_end;
+
+	// 弹性线程数
+	static constexpr size_t no_worker = static_cast<size_t>(-1);
+	const size_t min_threads = 1;
+	const bool elastic = false;
+	const int64_t scale_up_wait_ns = 0;
+	const std::chrono::milliseconds idle_timeout;
+	size_t active_workers = 0;
+	bool spawning = false;
+	std::thread monitor;
+	std::condition_variable monitor_condition;
+
+	// 保护 workers，析构开始后 joining 为 true，不再启动新线程
+	std::mutex worker_mutex;
+	bool joining = false;
+	std::vector< std::thread > workers;
+	std::vector< std::unique_ptr<worker_domain> > domains;
+	std::vector< std::unique_ptr<worker_context> > contexts;
+
+	task_slab task_nodes;
+
+	std::mutex task_group_mutex;
+	size_t pending_tasks = 0;
+	size_t blocked_producers = 0;
+	std::condition_variable space_condition;
+	ThreadPoolStats pool_stats;
+	uint64_t group_uid = 0;
+	std::unordered_map< uint32_t, task_group_t > task_group;
+
+	// 未绑定节点的分组，每个优先级一个就绪环
+	ready_ring ready_rings[3];
 };
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "thread_pool.h"
+
+// 基于 ThreadPool 的并行算法，任务提交到 group_id 分组
+// 调用线程也领取并执行分块，不会空等，在线程池自己的线程中调用也不会死锁
+// grain 为 0 时先在调用线程上串行执行一小段，按测得的单个元素耗时选择每块的元素数
+// 只支持随机访问迭代器，返回前所有元素都已处理完毕，第一个异常会在调用线程中重新抛出
+
+namespace parallel_detail
+{
+	using clock = std::chrono::steady_clock;
+
+	// 每块的目标耗时，远大于一次任务调度的开销
+	constexpr int64_t target_chunk_ns = 50000;
+	// 测量阶段的最短耗时，同时也是每块耗时的下限
+	constexpr int64_t probe_ns = 5000;
+	// 每个线程平均至少分到的块数，避免个别慢块拖慢整体
+	constexpr size_t chunks_per_thread = 4;
+	// parallel_sort 每个分段的最少元素数
+	constexpr size_t min_sort_block = 4096;
+
+	inline int64_t elapsed_ns(clock::time_point since)
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - since).count();
+	}
+
+	// 调用线程和线程池中的协助任务通过原子下标领取 [next, last) 中的块
+	// 协助任务可能在调用线程返回之后才开始执行，此时领取不到块，也就不会访问 body
+	template<class Body>
+	class chunk_state
+	{
+	public:
+		chunk_state(Body &body, size_t first, size_t last, size_t grain)
+			: body(body), next(first), last(last), grain(grain)
+		{
+		}
+
+		void run()
+		{
+			// 先登记再领取，调用线程领取失败后看到 running 为 0 即表示已领取的块都执行完了
+			++running;
+			for (;;)
+			{
+				size_t begin = next.fetch_add(grain);
+				if (begin >= last)
+					break;
+
+				try
+				{
+					body(begin, std::min(begin + grain, last));
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					if (!error)
+						error = std::current_exception();
+					// 其他线程不再领取新的块
+					next = last;
+				}
+			}
+
+			if (--running == 0)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				condition.notify_all();
+			}
+		}
+
+		void wait()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [this] { return running == 0; });
+			if (error)
+				std::rethrow_exception(error);
+		}
+
+	private:
+		Body &body;
+		std::atomic<size_t> next;
+		const size_t last;
+		const size_t grain;
+		std::atomic<size_t> running{ 0 };
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::exception_ptr error;
+	};
+
+	// 对 [first, last) 分块执行 body(begin, end)
+	template<class Body>
+	void for_each_chunk(ThreadPool &pool, uint32_t group_id, size_t first, size_t last, size_t grain, Body &body)
+	{
+		if (first >= last)
+			return;
+
+		// 调用线程也参与执行
+		size_t threads = pool.thread_count() + 1;
+		size_t balance_grain = std::max<size_t>((last - first) / (threads * chunks_per_thread), 1);
+
+		if (grain == 0)
+		{
+			// 每次执行的元素数翻倍，直到耗时足以估计单个元素的开销
+			size_t done = 0;
+			int64_t spent = 0;
+			for (size_t step = 1; first < last && spent < probe_ns && done < balance_grain; step *= 2)
+			{
+				size_t count = std::min(std::min(step, last - first), balance_grain - done);
+				clock::time_point start = clock::now();
+				body(first, first + count);
+				spent += elapsed_ns(start);
+				first += count;
+				done += count;
+			}
+
+			if (first >= last)
+				return;
+
+			double cost = static_cast<double>(std::max<int64_t>(spent, 1)) / static_cast<double>(done);
+			// 剩余的工作量不够一块时不值得提交任务
+			if (cost * static_cast<double>(last - first) < static_cast<double>(target_chunk_ns))
+			{
+				body(first, last);
+				return;
+			}
+
+			// 块不能太大以保证负载均衡，也不能太小以免调度开销占比过高
+			size_t target_grain = static_cast<size_t>(static_cast<double>(target_chunk_ns) / cost);
+			size_t min_grain = static_cast<size_t>(static_cast<double>(probe_ns) / cost);
+			grain = std::max(std::min(target_grain, balance_grain), min_grain);
+			grain = std::max<size_t>(grain, 1);
+		}
+
+		size_t chunks = (last - first + grain - 1) / grain;
+		size_t helpers = std::min(threads - 1, chunks - 1);
+		if (helpers == 0)
+		{
+			body(first, last);
+			return;
+		}
+
+		auto state = std::make_shared<chunk_state<Body>>(body, first, last, grain);
+		auto helper = [state] { state->run(); };
+		std::vector<decltype(helper)> tasks(helpers, helper);
+		// 队列已满被拒绝时由调用线程完成全部工作
+		pool.post_bulk(group_id, tasks);
+		tasks.clear();
+
+		state->run();
+		state->wait();
+	}
+
+	struct identity
+	{
+		template<class T>
+		T&& operator()(T &&value) const noexcept
+		{
+			return std::forward<T>(value);
+		}
+	};
+
+	template<class Iter>
+	using require_random_access = std::enable_if_t<std::is_base_of<std::random_access_iterator_tag, typename std::iterator_traits<Iter>::iterator_category>::value, int>;
+}
+
+// 对 [first, last) 中的每个下标调用 f(i)
+template<class Index, class F, std::enable_if_t<std::is_integral<Index>::value, int> = 0>
+void parallel_for(ThreadPool &pool, uint32_t group_id, Index first, Index last, F &&f, size_t grain = 0)
+{
+	if (!(first < last))
+		return;
+
+	auto body = [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i)
+			f(static_cast<Index>(first + static_cast<Index>(i)));
+	};
+	parallel_detail::for_each_chunk(pool, group_id, 0, static_cast<size_t>(last - first), grain, body);
+}
+
+// 对 [first, last) 中的每个元素调用 f(*it)
+template<class Iter, class F, parallel_detail::require_random_access<Iter> = 0>
+void parallel_for(ThreadPool &pool, uint32_t group_id, Iter first, Iter last, F &&f, size_t grain = 0)
+{
+	auto body = [&](size_t begin, size_t end) {
+		Iter it = first + begin;
+		for (size_t i = begin; i < end; ++i, ++it)
+			f(*it);
+	};
+	parallel_detail::for_each_chunk(pool, group_id, 0, static_cast<size_t>(std::distance(first, last)), grain, body);
+}
+
+// 同 std::transform_reduce，reduce 需满足结合律和交换律，各块结果的合并顺序不确定
+template<class Iter, class T, class Reduce, class Transform, parallel_detail::require_random_access<Iter> = 0>
+T parallel_transform_reduce(ThreadPool &pool, uint32_t group_id, Iter first, Iter last, T init, Reduce reduce, Transform transform, size_t grain = 0)
+{
+	std::mutex mutex;
+	T res = std::move(init);
+	auto body = [&](size_t begin, size_t end) {
+		Iter it = first + begin;
+		T partial = transform(*it);
+		for (++begin, ++it; begin < end; ++begin, ++it)
+			partial = reduce(std::move(partial), transform(*it));
+
+		std::lock_guard<std::mutex> lock(mutex);
+		res = reduce(std::move(res), std::move(partial));
+	};
+	parallel_detail::for_each_chunk(pool, group_id, 0, static_cast<size_t>(std::distance(first, last)), grain, body);
+	return res;
+}
+
+// 同 std::reduce
+template<class Iter, class T, class Reduce = std::plus<>, parallel_detail::require_random_access<Iter> = 0>
+T parallel_reduce(ThreadPool &pool, uint32_t group_id, Iter first, Iter last, T init, Reduce reduce = Reduce(), size_t grain = 0)
+{
+	return parallel_transform_reduce(pool, group_id, first, last, std::move(init), std::move(reduce), parallel_detail::identity(), grain);
+}
+
+// 按线程数分段并行排序，再逐轮并行地两两归并相邻分段，不稳定
+template<class Iter, class Compare = std::less<>, parallel_detail::require_random_access<Iter> = 0>
+void parallel_sort(ThreadPool &pool, uint32_t group_id, Iter first, Iter last, Compare comp = Compare())
+{
+	size_t count = static_cast<size_t>(std::distance(first, last));
+	size_t blocks = std::min(pool.thread_count() + 1, count / parallel_detail::min_sort_block);
+	if (blocks < 2)
+	{
+		std::sort(first, last, comp);
+		return;
+	}
+
+	std::vector<size_t> bounds(blocks + 1);
+	for (size_t i = 0; i <= blocks; ++i)
+		bounds[i] = count * i / blocks;
+
+	auto sort_blocks = [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i)
+			std::sort(first + bounds[i], first + bounds[i + 1], comp);
+	};
+	parallel_detail::for_each_chunk(pool, group_id, 0, blocks, 1, sort_blocks);
+
+	for (size_t width = 1; width < blocks; width *= 2)
+	{
+		auto merge_pairs = [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i)
+			{
+				size_t low = i * 2 * width;
+				size_t middle = std::min(low + width, blocks);
+				size_t high = std::min(low + 2 * width, blocks);
+				if (middle < high)
+					std::inplace_merge(first + bounds[low], first + bounds[middle], first + bounds[high], comp);
+			}
+		};
+		parallel_detail::for_each_chunk(pool, group_id, 0, (blocks + 2 * width - 1) / (2 * width), 1, merge_pairs);
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include "thread_pool.h"
+
+// ThreadPool::metrics() 转换为 json，直方图只输出常用的分位数
+// nlohmann::json j = pool.metrics();
+
+inline void to_json(nlohmann::json &j, const latency_histogram::snapshot &histogram)
+{
+	j = nlohmann::json{
+		{ "count", histogram.count },
+		{ "mean", histogram.mean() },
+		{ "max", histogram.max },
+		{ "p50", histogram.percentile(50) },
+		{ "p90", histogram.percentile(90) },
+		{ "p99", histogram.percentile(99) },
+		{ "p999", histogram.percentile(99.9) },
+	};
+}
+
+inline void to_json(nlohmann::json &j, const ThreadPoolGroupStats &stats)
+{
+	j = nlohmann::json{
+		{ "queue_depth", stats.queue_depth },
+		{ "max_queue_depth", stats.max_queue_depth },
+		{ "enqueued", stats.enqueued },
+		{ "dequeued", stats.dequeued },
+		{ "total_wait_us", stats.total_wait_us },
+		{ "max_wait_us", stats.max_wait_us },
+		{ "overflows", stats.overflows },
+		{ "rejected", stats.rejected },
+		{ "dropped", stats.dropped },
+	};
+}
+
+inline void to_json(nlohmann::json &j, const ThreadPoolStats &stats)
+{
+	j = nlohmann::json{
+		{ "pending_tasks", stats.pending_tasks },
+		{ "max_pending_tasks", stats.max_pending_tasks },
+		{ "overflows", stats.overflows },
+		{ "rejected", stats.rejected },
+		{ "dropped", stats.dropped },
+		{ "blocked_producers", stats.blocked_producers },
+		{ "active_workers", stats.active_workers },
+	};
+}
+
+inline void to_json(nlohmann::json &j, const ThreadPoolWorkerMetrics &metrics)
+{
+	j = nlohmann::json{
+		{ "worker", metrics.worker },
+		{ "numa_node", metrics.numa_node },
+		{ "active", metrics.active },
+		{ "executed", metrics.executed },
+		{ "busy_ns", metrics.busy_ns },
+		{ "uptime_ns", metrics.uptime_ns },
+		{ "utilization", metrics.utilization },
+		{ "exec_ns", metrics.exec_ns },
+	};
+}
+
+inline void to_json(nlohmann::json &j, const ThreadPoolGroupMetrics &metrics)
+{
+	j = nlohmann::json{
+		{ "group_id", metrics.group_id },
+		{ "stats", metrics.stats },
+		{ "wait_ns", metrics.wait_ns },
+		{ "exec_ns", metrics.exec_ns },
+	};
+}
+
+inline void to_json(nlohmann::json &j, const ThreadPoolMetrics &metrics)
+{
+	j = nlohmann::json{
+		{ "stats", metrics.stats },
+		{ "workers", metrics.workers },
+		{ "groups", metrics.groups },
+	};
+}
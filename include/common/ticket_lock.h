@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+
+#include "spin_lock.h"
+
+// 排队取号的自旋锁，按 lock 的调用顺序先进先出地获得锁，不会有线程饿死
+// 所有等待者读同一个 serving，每次释放都会让它们的缓存行失效，等待者很多时用 mcs_lock
+// 线程数超过核数时，轮到的线程可能未被调度，后面的线程只能等它，此时吞吐量低于 spin_lock
+class ticket_lock
+{
+public:
+	ticket_lock() = default;
+	ticket_lock(const ticket_lock &) = delete;
+	ticket_lock(ticket_lock &&) = delete;
+	ticket_lock& operator=(const ticket_lock &) = delete;
+
+	void lock()
+	{
+		uint32_t ticket = next.fetch_add(1, std::memory_order_relaxed);
+		spin_backoff backoff;
+		while (serving.load(std::memory_order_acquire) != ticket)
+			backoff.pause();
+	}
+
+	bool try_lock()
+	{
+		// 没有人持有或排队时 next 等于 serving
+		uint32_t current = serving.load(std::memory_order_acquire);
+		uint32_t expected = current;
+		return next.compare_exchange_strong(expected, current + 1, std::memory_order_acquire, std::memory_order_relaxed);
+	}
+
+	void unlock()
+	{
+		// 只有持有者会修改 serving
+		serving.store(serving.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+private:
+	// 取号和叫号分开在两个缓存行，新来的线程取号时不会让等待者的缓存行失效
+	std::atomic<uint32_t> next{ 0 };
+	char next_padding[cache_line_size - sizeof(std::atomic<uint32_t>)];
+	std::atomic<uint32_t> serving{ 0 };
+};
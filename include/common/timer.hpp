@@ -5,6 +5,8 @@
 #pragma once
 
 #include <cstdint>
+#include <algorithm>
+#include <limits>
 #include <mutex>
 #include <thread>
 #include <condition_variable>
@@ -12,108 +14,1139 @@
 #include <chrono>
 #include <memory>
 #include <functional>
-#include <queue>
-#include <unordered_map>
+#include <stdexcept>
+#include <vector>
+
+#include "cpu_affinity.h"
+#include "histogram.hpp"
+#include "small_function.hpp"
+#include "spin_lock.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if __linux__
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
+struct TimerExecutorOptions
+{
+	size_t threads = 1;
+
+	// 线程可以运行的 CPU，为空时不设置亲和性
+	std::vector<int> cpus;
+
+	// 为 true 时第 i 个线程只绑定 cpus[i % cpus.size()]，否则所有线程共用 cpus
+	bool pin_threads = false;
+
+	// 使用分层时间轮代替最小堆，插入和删除都是 O(1)，删除的定时器立即释放
+	// 到期时间按 tick_us 向上取整，定时器不会提前触发，但最多可能延后一个 tick
+	bool timing_wheel = false;
+	uint32_t tick_us = 1000;
+
+	// 设置后定时器线程只负责计时，到期的回调交给 dispatcher 投递到其他执行器中执行，例如
+	// TimerExecutor::post_to(thread_pool, group_id) 或 [&io](small_function<void()> task) { asio::post(io, std::move(task)); }
+	// 同一个定时器的回调不会并发执行，interval 定时器在回调执行完后才开始下一次计时，fixed_rate 定时器按原定的周期点计时
+	// 投递出去的回调未执行就被销毁（例如队列已满被拒绝）或 dispatcher 抛出异常时，本次回调被跳过
+	std::function<void(small_function<void()>)> dispatcher;
+
+	// 定时器的默认容差，定时器可以在 [到期时间, 到期时间 + slack_us] 内的任意时刻触发
+	// 到期时间相近的定时器会对齐到同一时刻一起触发，减少线程唤醒次数，可以用 set_slack 单独设置
+	uint32_t slack_us = 0;
+
+	// 仅 Linux：不创建定时器线程（忽略 threads），只有一个分片，最早的到期时间设置到一个 timerfd 上
+	// 由外部事件循环监听 fd() 可读后调用 run_expired()，例如和 socket 一起 epoll，或者在 asio 中
+	// asio::posix::stream_descriptor fd(io, ::dup(executor.fd())) 并在 async_wait(wait_read) 的回调中调用 run_expired()
+	bool timerfd = false;
+};
+
+struct TimerExecutorStats
+{
+	// 定时器线程从等待中醒来的次数
+	uint64_t wakeups = 0;
+	// 触发的回调数，与 wakeups 之比反映合并的效果
+	uint64_t fired = 0;
+};
+
+// fixed_rate 定时器回调执行太久或线程被阻塞、错过了周期点时的处理方式
+enum class TimerMissedTicks
+{
+	// 立即逐个补上错过的执行，执行次数与经过的周期数一致
+	catch_up,
+	// 丢弃错过的执行，下次在之后的第一个周期点执行
+	skip,
+};
+
+// 单个定时器的执行统计，延迟为实际触发时间与原定到期时间之差
+// 设置了 dispatcher 时只统计到投递为止，不含在其他执行器中排队的时间
+struct TimerJitterStats
+{
+	uint64_t runs = 0;
+	// TimerMissedTicks::skip 跳过的周期数
+	uint64_t skipped = 0;
+
+	int64_t last_late_us = 0;
+	int64_t max_late_us = 0;
+	int64_t total_late_us = 0;
+
+	int64_t mean_late_us() const
+	{
+		return runs ? total_late_us / static_cast<int64_t>(runs) : 0;
+	}
+};
 
 class TimerExecutor
 {
+	// 定时器节点由 TimerTaskPool 统一分配和回收，不单独分配内存
 	struct TimerTask
 	{
-		TimerTask() = default;
+		static constexpr uint32_t no_slot = UINT32_MAX;
+		static constexpr uint32_t generation_mask = 0xFFFFFF;
+		static constexpr uint32_t stoped_bit = 0x80000000;
+
+		// 可调用对象不超过 small_function 的容量时不分配内存
+		small_function<void(), 6 * sizeof(void *)> task;
+
+		// 下次执行的时间
+		int64_t next_run_time{};
+		// 加上容差并对齐后最晚的触发时间，最小堆按它排序
+		int64_t expire_time{};
+		uint32_t slack_us{};
+
+		int64_t interval{};
+
+		TimerJitterStats jitter;
+
+		// 时间轮中所在的槽或者最小堆中的下标，不在其中时为 no_slot
+		uint32_t slot{ no_slot };
+		TimerTask *prev{};
+		// 同时用于空闲链表
+		TimerTask *next{};
+		uint64_t expire_tick{};
+
+		// 节点在池中的下标，句柄由 index 和 generation 组成
+		uint32_t index{};
+		// 低 24 位在节点每次回收时递增，旧句柄随之失效；stoped_bit 表示已被删除，由删除的线程不加锁 CAS 设置
+		std::atomic<uint32_t> generation{};
+
+		bool stoped() const
+		{
+			return (generation.load(std::memory_order_acquire) & stoped_bit) != 0;
+		}
+
+		// 正在某个线程中执行，此时由执行线程负责重新调度或回收
+		bool running{};
+		// 执行期间被 rearm，执行完后按 next_run_time 重新调度
+		bool rearmed{};
+		// 下次到期时间 = 本次到期时间 + interval，不随回调耗时和调度延迟漂移
+		bool fixed_rate{};
+		bool skip_missed{};
+	};
+
+	// 分层时间轮：第 0 层每个槽对应一个 tick，往上每层的一个槽覆盖下一层的一整圈
+	// 插入和删除都是 O(1)，走到一圈的起点时把上层对应的槽重新分配到下层（cascade）
+	class TimerWheel
+	{
+		static constexpr unsigned root_bits = 8;
+		static constexpr unsigned level_bits = 6;
+		static constexpr unsigned levels = 5;
+		static constexpr size_t root_size = size_t(1) << root_bits;
+		static constexpr size_t level_size = size_t(1) << level_bits;
+		static constexpr size_t slot_count = root_size + (levels - 1) * level_size;
+		// 已到期、等待执行的任务也挂在一个槽上，删除时不用区分
+		static constexpr size_t expired_slot = slot_count;
+		// 超出范围的任务先放在最高层，cascade 时再按真实的到期时间重新分配
+		static constexpr uint64_t max_delta = (uint64_t(1) << (root_bits + (levels - 1) * level_bits)) - 1;
 
-		TimerTask(int64_t next_run_time, std::function<void()> &&task, uint32_t interval = 0)
-			: next_run_time(next_run_time), task(std::move(task)), interval(interval)
+		struct Slot
 		{
+			TimerTask *head = nullptr;
+			TimerTask *tail = nullptr;
+		};
 
+	public:
+		explicit TimerWheel(uint64_t current_tick)
+			: current(current_tick)
+		{
 		}
 
-		bool stoped{};
+		void insert(TimerTask *task)
+		{
+			uint64_t expire = std::max(task->expire_tick, current);
+			uint64_t delta = expire - current;
+			if (delta > max_delta)
+			{
+				delta = max_delta;
+				expire = current + delta;
+			}
+
+			size_t index = expire & (root_size - 1);
+			if (delta >= root_size)
+			{
+				unsigned level = 1;
+				while (delta >= (uint64_t(1) << (root_bits + level * level_bits)))
+					++level;
+				index = root_size + (level - 1) * level_size + ((expire >> (root_bits + (level - 1) * level_bits)) & (level_size - 1));
+			}
 
-		uint32_t interval{};
+			link(task, index);
+			++count;
+		}
 
-		uint64_t timer_id{};
+		void erase(TimerTask *task)
+		{
+			if (task->slot == TimerTask::no_slot)
+				return;
+			if (task->slot != expired_slot)
+				--count;
+			unlink(task);
+		}
 
-		// 下次执行的时间
-		int64_t next_run_time{};
+		// 推进到 now_tick（包含），到期的任务移到 expired 槽
+		void advance(uint64_t now_tick)
+		{
+			while (current <= now_tick)
+			{
+				if (count == 0)
+				{
+					current = now_tick + 1;
+					return;
+				}
+
+				size_t index = current & (root_size - 1);
+				if (index == 0)
+					cascade();
+
+				Slot &slot = slots[index];
+				for (TimerTask *task = slot.head; task; task = task->next)
+				{
+					task->slot = static_cast<uint32_t>(expired_slot);
+					--count;
+				}
+				if (slot.head)
+				{
+					Slot &expired = slots[expired_slot];
+					slot.head->prev = expired.tail;
+					if (expired.tail)
+						expired.tail->next = slot.head;
+					else
+						expired.head = slot.head;
+					expired.tail = slot.tail;
+					slot = Slot();
+					occupied[index / 64] &= ~(uint64_t(1) << (index % 64));
+				}
+
+				// 中间没有任务的 tick 直接跳过
+				++current;
+				current = std::min(next_tick(), now_tick + 1);
+			}
+		}
+
+		TimerTask *pop_expired()
+		{
+			TimerTask *task = slots[expired_slot].head;
+			if (task)
+				unlink(task);
+			return task;
+		}
+
+		// 下一个需要处理的 tick，没有任务时返回 UINT64_MAX
+		uint64_t next_tick() const
+		{
+			if (count == 0)
+				return std::numeric_limits<uint64_t>::max();
+
+			// 第 0 层本圈内最近的非空槽，没有则在下一圈开始时 cascade
+			size_t index = current & (root_size - 1);
+			// 处在一圈的起点时上层的 cascade 还没做，必须在这个 tick 醒来
+			if (index == 0)
+				return current;
+			uint64_t round = current - index;
+			for (size_t word = index / 64; word < root_size / 64; ++word)
+			{
+				uint64_t bits = occupied[word];
+				if (word == index / 64)
+					bits &= ~uint64_t(0) << (index % 64);
+				if (bits)
+					return round + word * 64 + lowest_bit(bits);
+			}
+			return round + root_size;
+		}
+
+		bool has_expired() const
+		{
+			return slots[expired_slot].head != nullptr;
+		}
+
+	private:
+		void cascade()
+		{
+			for (unsigned level = 1; level < levels; ++level)
+			{
+				size_t index = (current >> (root_bits + (level - 1) * level_bits)) & (level_size - 1);
+				size_t slot_index = root_size + (level - 1) * level_size + index;
+				Slot slot = slots[slot_index];
+				slots[slot_index] = Slot();
+				occupied[slot_index / 64] &= ~(uint64_t(1) << (slot_index % 64));
+
+				for (TimerTask *task = slot.head; task;)
+				{
+					TimerTask *next = task->next;
+					--count;
+					insert(task);
+					task = next;
+				}
+
+				if (index != 0)
+					break;
+			}
+		}
+
+		void link(TimerTask *task, size_t index)
+		{
+			Slot &slot = slots[index];
+			task->slot = static_cast<uint32_t>(index);
+			task->prev = slot.tail;
+			task->next = nullptr;
+			if (slot.tail)
+				slot.tail->next = task;
+			else
+				slot.head = task;
+			slot.tail = task;
+			if (index < slot_count)
+				occupied[index / 64] |= uint64_t(1) << (index % 64);
+		}
+
+		void unlink(TimerTask *task)
+		{
+			size_t index = task->slot;
+			Slot &slot = slots[index];
+			if (task->prev)
+				task->prev->next = task->next;
+			else
+				slot.head = task->next;
+			if (task->next)
+				task->next->prev = task->prev;
+			else
+				slot.tail = task->prev;
+			task->prev = task->next = nullptr;
+			task->slot = TimerTask::no_slot;
+			if (!slot.head && index < slot_count)
+				occupied[index / 64] &= ~(uint64_t(1) << (index % 64));
+		}
+
+		static unsigned lowest_bit(uint64_t value) noexcept
+		{
+#if defined(_MSC_VER) && defined(_WIN64)
+			unsigned long index = 0;
+			_BitScanForward64(&index, value);
+			return static_cast<unsigned>(index);
+#elif defined(__GNUC__) || defined(__clang__)
+			return static_cast<unsigned>(__builtin_ctzll(value));
+#else
+			unsigned index = 0;
+			while (!(value & 1))
+			{
+				value >>= 1;
+				++index;
+			}
+			return index;
+#endif
+		}
+
+	private:
+		// 下一个待处理的 tick
+		uint64_t current;
+		// 各层槽中的任务数，不含已到期的
+		size_t count = 0;
+		Slot slots[slot_count + 1];
+		uint64_t occupied[(slot_count + 63) / 64] = {};
+	};
+
+	// 按 expire_time 排序的最小堆，节点记录自己在堆中的下标，删除是 O(log n)
+	class TimerHeap
+	{
+	public:
+		bool empty() const
+		{
+			return nodes.empty();
+		}
+
+		TimerTask *top() const
+		{
+			return nodes.front();
+		}
+
+		void push(TimerTask *task)
+		{
+			task->slot = static_cast<uint32_t>(nodes.size());
+			nodes.push_back(task);
+			sift_up(task->slot);
+		}
+
+		void erase(TimerTask *task)
+		{
+			size_t index = task->slot;
+			if (index == TimerTask::no_slot)
+				return;
+
+			TimerTask *last = nodes.back();
+			nodes.pop_back();
+			task->slot = TimerTask::no_slot;
+			if (last != task)
+			{
+				place(index, last);
+				sift_down(index);
+				sift_up(last->slot);
+			}
+		}
+
+		TimerTask *pop()
+		{
+			TimerTask *task = top();
+			erase(task);
+			return task;
+		}
+
+	private:
+		void sift_up(size_t index)
+		{
+			TimerTask *task = nodes[index];
+			while (index > 0)
+			{
+				size_t parent = (index - 1) / 2;
+				if (nodes[parent]->expire_time <= task->expire_time)
+					break;
+				place(index, nodes[parent]);
+				index = parent;
+			}
+			place(index, task);
+		}
+
+		void sift_down(size_t index)
+		{
+			TimerTask *task = nodes[index];
+			for (;;)
+			{
+				size_t child = index * 2 + 1;
+				if (child >= nodes.size())
+					break;
+				if (child + 1 < nodes.size() && nodes[child + 1]->expire_time < nodes[child]->expire_time)
+					++child;
+				if (task->expire_time <= nodes[child]->expire_time)
+					break;
+				place(index, nodes[child]);
+				index = child;
+			}
+			place(index, task);
+		}
+
+		void place(size_t index, TimerTask *task)
+		{
+			nodes[index] = task;
+			task->slot = static_cast<uint32_t>(index);
+		}
+
+	private:
+		std::vector<TimerTask *> nodes;
+	};
+
+	// 定时器节点池，节点按块分配、地址固定，回收后放入空闲链表复用
+	// 句柄从高到低依次是 24 位 generation、8 位分片号、32 位 index + 1，查找时校验 generation，不需要哈希表
+	// 生产者线程在 free_lock 下分配节点，块指针表大小固定，按句柄查找节点不需要加锁
+	class TimerTaskPool
+	{
+		static constexpr size_t chunk_size = 4096;
+		// 每个分片最多 16M 个同时存在的定时器
+		static constexpr size_t max_chunks = 4096;
+
+	public:
+		explicit TimerTaskPool(uint32_t shard)
+			: shard(shard)
+		{
+		}
+
+		~TimerTaskPool()
+		{
+			for (size_t i = 0; i < chunk_count; ++i)
+				delete[] chunks[i].load(std::memory_order_relaxed);
+		}
+
+		TimerTask *allocate()
+		{
+			std::lock_guard<spin_lock> lock(free_lock);
+			if (!free_tasks)
+				grow();
+
+			TimerTask *task = free_tasks;
+			free_tasks = task->next;
+			task->next = nullptr;
+			return task;
+		}
+
+		// 需持有分片的 mutex
+		void release(TimerTask *task)
+		{
+			// 先让旧句柄失效，同时清除 stoped_bit
+			uint32_t generation = task->generation.load(std::memory_order_relaxed);
+			task->generation.store((generation + 1) & TimerTask::generation_mask, std::memory_order_release);
+			task->task = nullptr;
+			task->running = false;
+			task->rearmed = false;
+			task->fixed_rate = false;
+			task->skip_missed = false;
+			task->jitter = TimerJitterStats();
+
+			std::lock_guard<spin_lock> lock(free_lock);
+			task->next = free_tasks;
+			free_tasks = task;
+		}
+
+		// 句柄已失效时返回 nullptr，已删除但还没回收的节点也会返回，可以不加锁调用
+		TimerTask *find(uint64_t handle) const
+		{
+			uint32_t index = static_cast<uint32_t>(handle);
+			if (index == 0 || index > max_chunks * chunk_size)
+				return nullptr;
+
+			--index;
+			TimerTask *chunk = chunks[index / chunk_size].load(std::memory_order_acquire);
+			if (!chunk)
+				return nullptr;
+
+			TimerTask *task = &chunk[index % chunk_size];
+			uint32_t generation = task->generation.load(std::memory_order_acquire) & TimerTask::generation_mask;
+			return generation == static_cast<uint32_t>(handle >> 40) ? task : nullptr;
+		}
+
+		uint64_t handle(const TimerTask *task) const
+		{
+			uint32_t generation = task->generation.load(std::memory_order_relaxed) & TimerTask::generation_mask;
+			return (uint64_t(generation) << 40) | (uint64_t(shard) << 32) | (uint64_t(task->index) + 1);
+		}
+
+		static uint32_t shard_of(uint64_t handle)
+		{
+			return static_cast<uint32_t>(handle >> 32) & 0xFF;
+		}
+
+	private:
+		void grow()
+		{
+			if (chunk_count == max_chunks)
+				throw std::runtime_error("too many timers");
+
+			uint32_t base = static_cast<uint32_t>(chunk_count * chunk_size);
+			TimerTask *chunk = new TimerTask[chunk_size];
+			for (size_t i = chunk_size; i-- > 0;)
+			{
+				chunk[i].index = base + static_cast<uint32_t>(i);
+				chunk[i].next = free_tasks;
+				free_tasks = &chunk[i];
+			}
+			chunks[chunk_count++].store(chunk, std::memory_order_release);
+		}
+
+	private:
+		const uint32_t shard;
+		spin_lock free_lock;
+		TimerTask *free_tasks = nullptr;
+		size_t chunk_count = 0;
+		std::atomic<TimerTask *> chunks[max_chunks] = {};
+	};
+
+	// 生产者线程提交给分片的操作，由持有分片 mutex 的线程批量执行
+	struct TimerCommand
+	{
+		enum Type : uint32_t
+		{
+			// 节点已由生产者填好，加入堆/时间轮
+			arm,
+			// 改为在 time 触发
+			rearm,
+			// 节点已被标记为 stoped，从堆/时间轮中摘下并回收
+			cancel,
+		};
+
+		uint64_t timer_id;
+		int64_t time;
+		Type type;
+	};
+
+	// 有界的多生产者单消费者队列，生产者只做一次 CAS，消费者是当前持有分片 mutex 的线程
+	class TimerCommandQueue
+	{
+		static constexpr size_t capacity = 1024;
+
+		struct Cell
+		{
+			std::atomic<size_t> sequence;
+			TimerCommand command;
+		};
+
+	public:
+		TimerCommandQueue()
+		{
+			for (size_t i = 0; i < capacity; ++i)
+				cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+
+		// 队列已满时返回 false
+		bool push(const TimerCommand &command)
+		{
+			size_t pos = tail.load(std::memory_order_relaxed);
+			for (;;)
+			{
+				Cell &cell = cells[pos & (capacity - 1)];
+				size_t sequence = cell.sequence.load(std::memory_order_acquire);
+				intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+				if (diff == 0)
+				{
+					if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					{
+						cell.command = command;
+						cell.sequence.store(pos + 1, std::memory_order_release);
+						return true;
+					}
+				}
+				else if (diff < 0)
+					return false;
+				else
+					pos = tail.load(std::memory_order_relaxed);
+			}
+		}
+
+		// 需持有分片的 mutex
+		bool pop(TimerCommand &command)
+		{
+			Cell &cell = cells[head & (capacity - 1)];
+			if (cell.sequence.load(std::memory_order_acquire) != head + 1)
+				return false;
+
+			command = cell.command;
+			cell.sequence.store(head + capacity, std::memory_order_release);
+			++head;
+			return true;
+		}
+
+		// 已被领取但还没写完的位置也算非空
+		bool empty() const
+		{
+			return tail.load(std::memory_order_relaxed) == head;
+		}
+
+	private:
+		std::atomic<size_t> tail{ 0 };
+		char tail_padding[cache_line_size - sizeof(std::atomic<size_t>)];
+		size_t head = 0;
+		char head_padding[cache_line_size - sizeof(size_t)];
+		Cell cells[capacity];
+	};
+
+	// 每个分片有独立的锁、条件变量、节点池和堆/时间轮，线程只等待自己分片中最早到期的定时器
+	struct TimerShard
+	{
+		TimerShard(uint32_t index, bool timing_wheel, uint32_t tick_us)
+			: tasks(index)
+			, tick_us(tick_us)
+		{
+			if (timing_wheel)
+				wheel.reset(new TimerWheel(static_cast<uint64_t>(now_us()) / tick_us));
+		}
+
+		// 以下需持有 mutex
+		TimerTask *find_task(uint64_t timer_id) const
+		{
+			TimerTask *task = tasks.find(timer_id);
+			return task && !task->stoped() ? task : nullptr;
+		}
+
+		// 批量执行生产者提交的命令，返回是否需要唤醒定时器线程
+		bool drain_commands()
+		{
+			bool notify = false;
+			TimerCommand command;
+			while (commands.pop(command))
+				notify = apply(command) || notify;
+			return notify;
+		}
+
+		bool apply(const TimerCommand &command)
+		{
+			TimerTask *task = tasks.find(command.timer_id);
+			if (!task)
+				return false;
+
+			switch (command.type)
+			{
+			case TimerCommand::arm:
+				// 加入之前就被删除了
+				if (task->stoped())
+				{
+					tasks.release(task);
+					return false;
+				}
+				return schedule(task);
+
+			case TimerCommand::rearm:
+				if (task->stoped())
+					return false;
+				task->next_run_time = command.time;
+				if (task->running)
+				{
+					task->rearmed = true;
+					return false;
+				}
+				unlink_task(task);
+				return schedule(task);
+
+			case TimerCommand::cancel:
+				// 正在执行的定时器由执行线程回收
+				if (!task->running)
+				{
+					unlink_task(task);
+					tasks.release(task);
+				}
+				return false;
+			}
+			return false;
+		}
+
+		// 返回是否需要唤醒定时器线程
+		bool schedule(TimerTask *task)
+		{
+			if (wheel)
+			{
+				// 向上取整，保证不会提前触发
+				uint64_t first = static_cast<uint64_t>(task->next_run_time + tick_us - 1) / tick_us;
+				uint64_t last = static_cast<uint64_t>(task->next_run_time + task->slack_us) / tick_us;
+				task->expire_tick = apply_slack(first, last > first ? last - first : 0);
+				task->expire_time = static_cast<int64_t>(task->expire_tick * tick_us);
+				wheel->insert(task);
+			}
+			else
+			{
+				task->expire_time = static_cast<int64_t>(apply_slack(static_cast<uint64_t>(task->next_run_time), task->slack_us));
+				heap.push(task);
+			}
+
+			if (timer_fd >= 0)
+			{
+				if (task->expire_time < sleep_until)
+					arm_timer_fd(task->expire_time);
+				return false;
+			}
+
+			// 线程正在等待的时间早于新定时器时不需要唤醒，线程正在执行回调时会自己看到新定时器
+			return threads > 1 || task->expire_time < sleep_until;
+		}
+
+		// 把 timerfd 设置为在 deadline（steady_clock 的微秒数）到期，INT64_MAX 表示取消
+		void arm_timer_fd(int64_t deadline)
+		{
+			sleep_until = deadline;
+#if __linux__
+			// steady_clock 在 Linux 上即 CLOCK_MONOTONIC，全 0 表示取消，所以到期时间至少为 1ns
+			itimerspec spec{};
+			if (deadline != std::numeric_limits<int64_t>::max())
+			{
+				spec.it_value.tv_sec = static_cast<time_t>(deadline / 1000000);
+				spec.it_value.tv_nsec = static_cast<long>(deadline % 1000000 * 1000);
+				if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+					spec.it_value.tv_nsec = 1;
+			}
+			timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+#endif
+		}
+
+		void unlink_task(TimerTask *task)
+		{
+			if (wheel)
+				wheel->erase(task);
+			else
+				heap.erase(task);
+		}
+
+		// 取出一个已到期的任务，没有时通过 deadline 返回下一次需要醒来的时间，没有任何任务时为 INT64_MAX
+		TimerTask *pop_expired(int64_t now, int64_t &deadline)
+		{
+			if (wheel)
+			{
+				if (!wheel->has_expired())
+					wheel->advance(static_cast<uint64_t>(now) / tick_us);
+
+				if (TimerTask *task = wheel->pop_expired())
+					return task;
+
+				uint64_t next_tick = wheel->next_tick();
+				deadline = next_tick == std::numeric_limits<uint64_t>::max() ? std::numeric_limits<int64_t>::max() : static_cast<int64_t>(next_tick * tick_us);
+				return nullptr;
+			}
+
+			if (heap.empty())
+			{
+				deadline = std::numeric_limits<int64_t>::max();
+				return nullptr;
+			}
+
+			// 醒来后顺带触发已经到期、但最晚触发时间还没到的定时器
+			if (heap.top()->next_run_time > now)
+			{
+				deadline = heap.top()->expire_time;
+				return nullptr;
+			}
+			return heap.pop();
+		}
+
+		// 在 [value, value + slack] 中选低位 0 最多的值，到期时间相近的定时器会落在同一时刻
+		static uint64_t apply_slack(uint64_t value, uint64_t slack)
+		{
+			uint64_t limit = value + slack;
+			uint64_t mask = value ^ limit;
+			if (mask == 0)
+				return value;
+
+			mask = (uint64_t(1) << latency_histogram::highest_bit(mask)) - 1;
+			return limit & ~mask;
+		}
+
+		std::mutex mutex;
+		std::condition_variable condition;
+		// 定时器线程等待到的时间，没有线程在等待时为 INT64_MIN，生产者不加锁读取以决定是否需要唤醒
+		std::atomic<int64_t> sleep_until{ std::numeric_limits<int64_t>::min() };
+		// 服务该分片的线程数，多于一个时每次都需要唤醒
+		std::atomic<size_t> threads{ 0 };
+		TimerCommandQueue commands;
+		uint64_t wakeups = 0;
+		uint64_t fired = 0;
+		// 已投递、尚未执行完的回调数，析构时等待其归零
+		size_t dispatched = 0;
+		bool draining = false;
+		std::condition_variable drained;
+		TimerTaskPool tasks;
+		TimerHeap heap;
+		std::unique_ptr<TimerWheel> wheel;
+		const uint32_t tick_us;
+		// timerfd 模式下由外部事件循环监听，此时 sleep_until 为 timerfd 当前设置的到期时间
+		int timer_fd = -1;
+	};
+
+	// 分片号占句柄中的 8 位
+	static constexpr size_t max_shards = 256;
+
+	// 投递到其他执行器的回调，执行完或者未执行就被销毁时回到分片中重新调度或回收定时器
+	class DispatchedTask
+	{
+	public:
+		DispatchedTask(TimerExecutor *executor, TimerShard *shard, TimerTask *task) noexcept
+			: executor(executor), shard(shard), task(task)
+		{
+		}
+
+		DispatchedTask(DispatchedTask &&other) noexcept
+			: executor(other.executor), shard(other.shard), task(other.task)
+		{
+			other.task = nullptr;
+		}
+
+		DispatchedTask &operator=(DispatchedTask &&) = delete;
 
-		std::function<void()> task;
+		~DispatchedTask()
+		{
+			if (task)
+				executor->complete_dispatched(*shard, task);
+		}
 
-		static bool timer_task_priority(const std::shared_ptr<TimerTask> & lhs, const std::shared_ptr<TimerTask> &rhs)
+		void operator()()
 		{
-			return lhs->next_run_time > rhs->next_run_time;
+			// 交给 dispatcher 之后才被删除的定时器不再执行，节点照常回收
+			if (!task->stoped())
+				task->task();
+			TimerTask *finished = task;
+			task = nullptr;
+			executor->complete_dispatched(*shard, finished);
 		}
+
+	private:
+		TimerExecutor *executor;
+		TimerShard *shard;
+		TimerTask *task;
+	};
+
+	// 记录定时器线程服务的分片，回调中添加的定时器留在同一个分片
+	struct ShardBinding
+	{
+		const TimerExecutor *owner = nullptr;
+		size_t shard = 0;
 	};
 
-	using TimerTaskPtr = std::shared_ptr<TimerTask>;
 public:
 	TimerExecutor(size_t threads = 1)
-		: thread_count(threads)
-		, workers(threads)
+		: TimerExecutor(make_options(threads))
 	{
+	}
+
+	// 每个线程一个分片，线程数超过 max_shards 时多个线程共用一个分片
+	explicit TimerExecutor(const TimerExecutorOptions &options)
+		: thread_count(options.timerfd ? 0 : options.threads)
+		, cpus(options.cpus)
+		, pin_threads(options.pin_threads)
+		, dispatcher(options.dispatcher)
+		, slack_us(options.slack_us)
+		, workers(thread_count)
+	{
+		size_t count = std::max<size_t>(thread_count, 1);
+		if (count > max_shards)
+			count = max_shards;
+		uint32_t tick_us = std::max<uint32_t>(options.tick_us, 1);
+		for (size_t i = 0; i < count; ++i)
+			shards.emplace_back(new TimerShard(static_cast<uint32_t>(i), options.timing_wheel, tick_us));
+
+		if (options.timerfd)
+		{
+#if __linux__
+			TimerShard &shard = *shards[0];
+			shard.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+			if (shard.timer_fd < 0)
+				throw std::runtime_error("timerfd_create failed");
+			shard.sleep_until = std::numeric_limits<int64_t>::max();
+#else
+			throw std::runtime_error("timerfd is only supported on Linux");
+#endif
+		}
+
 		start();
 	}
 
 	~TimerExecutor()
 	{
 		stop();
+
+		// 投递出去的回调还会访问分片
+		for (auto &shard : shards)
+		{
+			std::unique_lock<std::mutex> lock(shard->mutex);
+			shard->draining = true;
+			shard->drained.wait(lock, [&] { return shard->dispatched == 0; });
+		}
+
+#if __linux__
+		if (shards[0]->timer_fd >= 0)
+			::close(shards[0]->timer_fd);
+#endif
 	}
 
+	// 返回定时器句柄，定时器结束或被删除后句柄失效，对失效句柄的操作会被忽略
+	// 定时器线程中添加的定时器放在该线程的分片，其他线程添加的按调用线程固定分配到一个分片
 	template<class Func, class... Args>
 	uint64_t timeout(uint32_t ms, Func &&func, Args &&... args)
 	{
-		uint64_t id = timer_id_incr.fetch_add(1);
-		auto new_task = std::make_shared<TimerTask>(now_us() + ms * 1000, std::bind(std::forward<Func>(func), std::forward<Args>(args) ...));
-		new_task->timer_id = id;
-		{
-			std::unique_lock<std::mutex> lock(task_mutex);
-			tasks.emplace(new_task);
-			timers[id] = new_task;
-		}
-		task_condition.notify_one();
-		return id;
+		return add_task(caller_shard(), ms, 0, std::bind(std::forward<Func>(func), std::forward<Args>(args) ...));
 	}
 
 	template<class Func, class... Args>
 	uint64_t interval(uint32_t ms, Func &&func, Args &&... args)
 	{
-		uint64_t id = timer_id_incr.fetch_add(1);
-		auto new_task = std::make_shared<TimerTask>(now_us() + ms * 1000, std::bind(std::forward<Func>(func), std::forward<Args>(args) ...), ms * 1000);
-		new_task->timer_id = id;
+		return add_task(caller_shard(), ms, int64_t(ms) * 1000, std::bind(std::forward<Func>(func), std::forward<Args>(args) ...));
+	}
+
+	// 固定频率执行，第 n 次的到期时间为首次到期时间 + n * ms，回调耗时不会累积成漂移
+	template<class Func, class... Args>
+	uint64_t fixed_rate(uint32_t ms, TimerMissedTicks missed, Func &&func, Args &&... args)
+	{
+		return add_task(caller_shard(), ms, int64_t(ms) * 1000, std::bind(std::forward<Func>(func), std::forward<Args>(args) ...), true, missed);
+	}
+
+	// 按 key 选择分片，key 相同（例如同一个连接）的定时器总在同一个分片、同一个线程中执行
+	template<class Func, class... Args>
+	uint64_t timeout_on(uint64_t key, uint32_t ms, Func &&func, Args &&... args)
+	{
+		return add_task(*shards[key % shards.size()], ms, 0, std::bind(std::forward<Func>(func), std::forward<Args>(args) ...));
+	}
+
+	template<class Func, class... Args>
+	uint64_t interval_on(uint64_t key, uint32_t ms, Func &&func, Args &&... args)
+	{
+		return add_task(*shards[key % shards.size()], ms, int64_t(ms) * 1000, std::bind(std::forward<Func>(func), std::forward<Args>(args) ...));
+	}
+
+	template<class Func, class... Args>
+	uint64_t fixed_rate_on(uint64_t key, uint32_t ms, TimerMissedTicks missed, Func &&func, Args &&... args)
+	{
+		return add_task(*shards[key % shards.size()], ms, int64_t(ms) * 1000, std::bind(std::forward<Func>(func), std::forward<Args>(args) ...), true, missed);
+	}
+
+	// 不加锁，返回后尚未开始的回调不会再执行，正在执行的回调执行完后回收
+	void remove_task(uint64_t timer_id)
+	{
+		TimerShard *shard = shard_of(timer_id);
+		if (!shard)
+			return;
+
+		TimerTask *task = shard->tasks.find(timer_id);
+		if (!task)
+			return;
+
+		// 节点已被回收复用或者已被删除时 CAS 失败
+		uint32_t generation = static_cast<uint32_t>(timer_id >> 40);
+		if (!task->generation.compare_exchange_strong(generation, generation | TimerTask::stoped_bit, std::memory_order_acq_rel))
+			return;
+		submit(*shard, TimerCommand{ timer_id, 0, TimerCommand::cancel });
+	}
+
+	void set_interval(uint64_t timer_id, uint32_t ms)
+	{
+		TimerShard *shard = shard_of(timer_id);
+		if (!shard)
+			return;
+
+		std::unique_lock<std::mutex> lock(shard->mutex);
+		if (TimerTask *task = shard->find_task(timer_id))
+			task->interval = int64_t(ms) * 1000;
+	}
+
+	// 把定时器的下次触发时间改为 ms 毫秒之后，复用原来的节点和句柄，不分配内存
+	// 不加锁，新的时间早于定时器线程正在等待的时间时才唤醒，适合每收到一个包就推迟一次的空闲超时
+	// 单次定时器已经触发完毕或定时器已被删除时返回 false，与触发同时发生时可能返回 true 但不再生效
+	bool rearm(uint64_t timer_id, uint32_t ms)
+	{
+		TimerShard *shard = shard_of(timer_id);
+		if (!shard)
+			return false;
+
+		TimerTask *task = shard->tasks.find(timer_id);
+		if (!task || task->stoped())
+			return false;
+
+		submit(*shard, TimerCommand{ timer_id, now_us() + int64_t(ms) * 1000, TimerCommand::rearm });
+		return true;
+	}
+
+	// 设置单个定时器的容差，已在等待中的定时器立即按新的容差重新排列
+	void set_slack(uint64_t timer_id, uint32_t slack_us)
+	{
+		TimerShard *shard = shard_of(timer_id);
+		if (!shard)
+			return;
+
+		bool notify = false;
 		{
+			std::unique_lock<std::mutex> lock(shard->mutex);
+			TimerTask *task = shard->find_task(timer_id);
+			if (!task)
+				return;
 
-			std::unique_lock<std::mutex> lock(task_mutex);
-			tasks.emplace(new_task);
-			timers[id] = new_task;
+			// 正在执行或 arm 命令还在队列中时，之后调度时自然会使用新的容差
+			task->slack_us = slack_us;
+			if (task->running || task->slot == TimerTask::no_slot)
+				return;
+			shard->unlink_task(task);
+			notify = shard->schedule(task);
 		}
-		task_condition.notify_one();
-		return id;
+		if (notify)
+			shard->condition.notify_one();
+	}
+
+	// 定时器已结束或已被删除时返回 false
+	bool jitter_stats(uint64_t timer_id, TimerJitterStats &stats)
+	{
+		TimerShard *shard = shard_of(timer_id);
+		if (!shard)
+			return false;
+
+		std::lock_guard<std::mutex> lock(shard->mutex);
+		TimerTask *task = shard->find_task(timer_id);
+		if (!task)
+			return false;
+
+		stats = task->jitter;
+		return true;
 	}
 
-	void remove_task(int64_t timer_id)
+	TimerExecutorStats stats()
 	{
+		TimerExecutorStats res;
+		for (auto &shard : shards)
 		{
-			std::unique_lock<std::mutex> lock(task_mutex);
-			auto it = timers.find(timer_id);
-			if (it != timers.end())
-			{
-				it->second->stoped = true;
-				timers.erase(it);
-			}
+			std::lock_guard<std::mutex> lock(shard->mutex);
+			res.wakeups += shard->wakeups;
+			res.fired += shard->fired;
 		}
-		task_condition.notify_one();
+		return res;
+	}
+
+	size_t shard_count() const
+	{
+		return shards.size();
+	}
+
+	// timerfd 模式下需要监听可读事件的 fd，其他模式返回 -1
+	int fd() const
+	{
+		return shards[0]->timer_fd;
 	}
 
-	void set_interval(int64_t timer_id, uint32_t ms)
+	// timerfd 模式下在事件循环线程中调用，在调用线程中执行（或交给 dispatcher 投递）所有已到期的定时器
+	// 并把 timerfd 设置为剩余定时器中最早的到期时间，返回触发的定时器数
+	size_t run_expired()
 	{
+		TimerShard &shard = *shards[0];
+		if (shard.timer_fd < 0)
+			return 0;
+
+#if __linux__
+		// fd 是非阻塞的，读出到期次数以清除可读状态
+		uint64_t expirations = 0;
+		if (::read(shard.timer_fd, &expirations, sizeof(expirations)) < 0)
+			expirations = 0;
+#endif
+
+		// 回调中添加的定时器同样放在这个分片
+		ShardBinding &binding = current_binding();
+		ShardBinding saved = binding;
+		binding.owner = this;
+		binding.shard = 0;
+
+		size_t count = 0;
+		std::unique_lock<std::mutex> lock(shard.mutex);
+		++shard.wakeups;
+		// 执行期间其他线程添加的定时器由下面的循环处理，不需要设置 timerfd
+		shard.sleep_until = std::numeric_limits<int64_t>::min();
+		for (;;)
 		{
-			std::unique_lock<std::mutex> lock(task_mutex);
-			auto it = timers.find(timer_id);
-			if (it != timers.end())
+			shard.drain_commands();
+			int64_t deadline = 0;
+			int64_t now = now_us();
+			TimerTask *task = shard.pop_expired(now, deadline);
+			if (task)
 			{
-				it->second->interval = ms * 1000;
+				if (fire_task(shard, task, now, lock))
+					++count;
+				continue;
 			}
+
+			shard.arm_timer_fd(deadline);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (shard.commands.empty())
+				break;
+			shard.sleep_until = std::numeric_limits<int64_t>::min();
+			std::this_thread::yield();
 		}
-		task_condition.notify_one();
+		lock.unlock();
+
+		binding = saved;
+		return count;
+	}
+
+	// 生成把回调投递到 executor.post(group_id, task) 的 dispatcher，例如 ThreadPool 的某个分组
+	template<class Executor>
+	static std::function<void(small_function<void()>)> post_to(Executor &executor, uint32_t group_id)
+	{
+		return [&executor, group_id](small_function<void()> task) {
+			executor.post(group_id, std::move(task));
+		};
 	}
 
 	void start()
@@ -122,7 +1155,15 @@ public:
 		{
 			for (size_t i = 0; i < thread_count; ++i)
 			{
-				workers[i] = std::thread(&TimerExecutor::internal_thread, this);
+				{
+					std::lock_guard<std::mutex> lock(shards[i % shards.size()]->mutex);
+					++shards[i % shards.size()]->threads;
+				}
+				workers[i] = std::thread(&TimerExecutor::internal_thread, this, i % shards.size());
+				if (pin_threads && !cpus.empty())
+					set_thread_affinity(workers[i], std::vector<int>{ cpus[i % cpus.size()] });
+				else
+					set_thread_affinity(workers[i], cpus);
 			}
 		}
 
@@ -132,71 +1173,247 @@ public:
 	{
 		if (active.exchange(false))
 		{
-			task_condition.notify_all();
+			// 加锁保证线程要么还没检查 active，要么已经在等待，不会错过通知
+			for (auto &shard : shards)
+			{
+				{
+					std::lock_guard<std::mutex> lock(shard->mutex);
+				}
+				shard->condition.notify_all();
+			}
 			for (auto & worker : workers)
 				if (worker.joinable())
 					worker.join();
+			for (auto &shard : shards)
+				shard->threads = 0;
 		}
 	}
 
 private:
-	void internal_thread()
+	template<class Task>
+	uint64_t add_task(TimerShard &shard, uint32_t ms, int64_t interval, Task &&task, bool fixed_rate = false, TimerMissedTicks missed = TimerMissedTicks::catch_up)
 	{
-		for (;;)
+		// 节点在入队之前只有当前线程能访问，不需要加锁
+		TimerTask *new_task = shard.tasks.allocate();
+		new_task->task = std::forward<Task>(task);
+		new_task->next_run_time = now_us() + int64_t(ms) * 1000;
+		new_task->interval = interval;
+		new_task->fixed_rate = fixed_rate;
+		new_task->skip_missed = missed == TimerMissedTicks::skip;
+		new_task->slack_us = slack_us;
+		uint64_t handle = shard.tasks.handle(new_task);
+		submit(shard, TimerCommand{ handle, new_task->next_run_time, TimerCommand::arm });
+		return handle;
+	}
+
+	// 命令放入分片的队列，只有新的到期时间早于线程正在等待的时间或者队列已满时才加锁
+	void submit(TimerShard &shard, const TimerCommand &command)
+	{
+		bool queued = shard.commands.push(command);
+		if (queued)
+		{
+			// 与定时器线程设置 sleep_until 后检查队列配对，两边至少有一方看到对方的写入
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (command.type == TimerCommand::cancel)
+				return;
+			if (shard.threads.load(std::memory_order_relaxed) <= 1 && command.time >= shard.sleep_until.load(std::memory_order_relaxed))
+				return;
+		}
+
+		bool notify = false;
 		{
-			std::shared_ptr<TimerTask> task;
-			bool trigger_task = false;
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			// 不能越过队列直接执行，同一个定时器之前的命令可能还在队列中
+			while (!queued)
 			{
-				std::unique_lock<std::mutex> lock(task_mutex);
+				notify = shard.drain_commands() || notify;
+				queued = shard.commands.push(command);
+				if (!queued)
+					std::this_thread::yield();
+			}
+			notify = shard.drain_commands() || notify;
 
-				if (tasks.empty())
-					task_condition.wait(lock, [&] { return !active || !tasks.empty(); });
+			// 有生产者领取了位置但还没写完，剩下的命令交给定时器线程执行
+			if (!shard.commands.empty())
+			{
+				if (shard.timer_fd >= 0)
+					shard.arm_timer_fd(now_us());
+				else
+					notify = true;
+			}
+		}
+		if (notify)
+			shard.condition.notify_one();
+	}
 
-				if (!active)
-					break;
+	TimerShard *shard_of(uint64_t timer_id) const
+	{
+		size_t index = TimerTaskPool::shard_of(timer_id);
+		return index < shards.size() ? shards[index].get() : nullptr;
+	}
 
-				while (!tasks.empty() && tasks.top()->stoped)
-				{
-					tasks.pop();
-				}
+	TimerShard &caller_shard()
+	{
+		const ShardBinding &binding = current_binding();
+		if (binding.owner == this)
+			return *shards[binding.shard];
+		return *shards[caller_index() % shards.size()];
+	}
 
-				if (tasks.empty())
-					continue;
+	static ShardBinding &current_binding()
+	{
+		thread_local ShardBinding binding;
+		return binding;
+	}
 
-				int64_t wait_time = std::max<int64_t>(now_us() - tasks.top()->next_run_time, 0);
-				trigger_task = task_condition.wait_for(lock, std::chrono::microseconds(wait_time), [&] {
-					if (!active || tasks.empty())
-						return true;
+	// 每个调用线程第一次添加定时器时分到一个序号，依次对应到各个分片
+	static size_t caller_index()
+	{
+		static std::atomic<size_t> next_caller{ 0 };
+		thread_local size_t index = next_caller.fetch_add(1, std::memory_order_relaxed);
+		return index;
+	}
 
-					const std::shared_ptr<TimerTask> &first_task = tasks.top();
-					if (now_us() >= first_task->next_run_time)
-					{
-						task = first_task;
-						tasks.pop();
-						return true;
-					}
-					return false;
-				});
+	void internal_thread(size_t shard_index)
+	{
+		ShardBinding &binding = current_binding();
+		binding.owner = this;
+		binding.shard = shard_index;
 
-				if (!active)
-					break;
-			}
-			if (trigger_task)
+		TimerShard &shard = *shards[shard_index];
+		std::unique_lock<std::mutex> lock(shard.mutex);
+		while (active)
+		{
+			shard.drain_commands();
+			int64_t deadline = 0;
+			int64_t now = now_us();
+			TimerTask *task = shard.pop_expired(now, deadline);
+			if (!task)
 			{
-				task->task();
-				if (task->interval > 0)
+				shard.sleep_until = deadline;
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				// 设置 sleep_until 之前提交的命令不会唤醒线程，需要先执行
+				if (!shard.commands.empty())
 				{
-					task->next_run_time = now_us() + task->interval;
-					std::unique_lock<std::mutex> lock(task_mutex);
-					tasks.emplace(std::move(task));
+					shard.sleep_until = std::numeric_limits<int64_t>::min();
+					std::this_thread::yield();
+					continue;
 				}
+
+				if (deadline == std::numeric_limits<int64_t>::max())
+					shard.condition.wait(lock);
 				else
-				{
-					std::unique_lock<std::mutex> lock(task_mutex);
-					timers.erase(task->timer_id);
-				}
+					shard.condition.wait_for(lock, std::chrono::microseconds(deadline - now_us()));
+				shard.sleep_until = std::numeric_limits<int64_t>::min();
+				++shard.wakeups;
+				continue;
 			}
+
+			fire_task(shard, task, now, lock);
 		}
+
+		binding = ShardBinding();
+	}
+
+	// 执行或投递一个已到期的定时器，调用前后都持有分片的 mutex，已被删除时直接回收并返回 false
+	bool fire_task(TimerShard &shard, TimerTask *task, int64_t now, std::unique_lock<std::mutex> &lock)
+	{
+		// 删除命令还在队列中
+		if (task->stoped())
+		{
+			shard.tasks.release(task);
+			return false;
+		}
+
+		++shard.fired;
+		int64_t late = std::max<int64_t>(now - task->next_run_time, 0);
+		++task->jitter.runs;
+		task->jitter.last_late_us = late;
+		task->jitter.max_late_us = std::max(task->jitter.max_late_us, late);
+		task->jitter.total_late_us += late;
+
+		// 执行期间节点不会被回收，其他线程只会修改调度相关的字段
+		task->running = true;
+		if (dispatcher)
+		{
+			++shard.dispatched;
+			lock.unlock();
+			try
+			{
+				dispatcher(DispatchedTask(this, &shard, task));
+			}
+			catch (...)
+			{
+			}
+			lock.lock();
+			return true;
+		}
+
+		lock.unlock();
+		task->task();
+		lock.lock();
+		finish_task(shard, task);
+		return true;
+	}
+
+	// 回调执行完毕后重新调度或回收，需持有分片的 mutex，返回是否需要唤醒定时器线程
+	bool finish_task(TimerShard &shard, TimerTask *task)
+	{
+		// 回调中提交的 rearm 要在 running 清除之前执行
+		bool notify = shard.drain_commands();
+		task->running = false;
+		if (task->stoped())
+		{
+			shard.tasks.release(task);
+			return notify;
+		}
+
+		if (task->rearmed)
+		{
+			task->rearmed = false;
+			return shard.schedule(task) || notify;
+		}
+
+		if (task->interval > 0)
+		{
+			int64_t now = now_us();
+			if (!task->fixed_rate)
+			{
+				task->next_run_time = now + task->interval;
+				return shard.schedule(task) || notify;
+			}
+
+			// catch_up 时已经过去的周期点会立即依次触发
+			task->next_run_time += task->interval;
+			if (task->skip_missed && task->next_run_time <= now)
+			{
+				int64_t missed = (now - task->next_run_time) / task->interval + 1;
+				task->next_run_time += missed * task->interval;
+				task->jitter.skipped += static_cast<uint64_t>(missed);
+			}
+			return shard.schedule(task) || notify;
+		}
+
+		shard.tasks.release(task);
+		return notify;
+	}
+
+	// 在锁内通知，析构函数看到 dispatched 归零后分片随时可能被销毁
+	void complete_dispatched(TimerShard &shard, TimerTask *task)
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		// 新的到期时间可能早于定时器线程正在等待的时间
+		if (finish_task(shard, task))
+			shard.condition.notify_one();
+		if (--shard.dispatched == 0 && shard.draining)
+			shard.drained.notify_all();
+	}
+
+	static TimerExecutorOptions make_options(size_t threads)
+	{
+		TimerExecutorOptions options;
+		options.threads = threads;
+		return options;
 	}
 
 	static int64_t now_us()
@@ -209,13 +1426,12 @@ private:
 
 	std::atomic_bool active{ false };
 	const size_t thread_count;
+	const std::vector<int> cpus;
+	const bool pin_threads = false;
+	const std::function<void(small_function<void()>)> dispatcher;
+	const uint32_t slack_us;
 
-	std::atomic_uint64_t timer_id_incr{ 1 };
-
-	std::condition_variable task_condition;
-	std::mutex task_mutex;
-	std::priority_queue<TimerTaskPtr, std::vector<TimerTaskPtr>, decltype(&TimerTask::timer_task_priority)> tasks{ &TimerTask::timer_task_priority };
-	std::unordered_map<uint64_t, TimerTaskPtr> timers;
+	std::vector<std::unique_ptr<TimerShard>> shards;
 
 	std::vector<std::thread> workers;
 };